@@ -71,6 +71,58 @@ assert open('a.wasm', 'rb').read()[0] == '\0', 'we emit binary by default'
 run_command(WASM_OPT + ['a.wasm', '-o', 'b.wast', '-S'])
 assert open('b.wast', 'rb').read()[0] != '\0', 'we emit text with -S'
 
+print '\n[ checking wasm-opt streaming binary writing... ]\n'
+
+wast = os.path.join(options.binaryen_test, 'emcc_hello_world.fromasm')
+for extra in [[], ['--minimal-sizes']]:
+  delete_from_orbit('a.wasm')
+  delete_from_orbit('b.wasm')
+  run_command(WASM_OPT + [wast, '-g', '-o', 'a.wasm'] + extra)
+  run_command(WASM_OPT + [wast, '-g', '-o', 'b.wasm', '--streaming-output'] + extra)
+  fail_if_not_identical(open('a.wasm', 'rb').read(), open('b.wasm', 'rb').read())
+  run_command(WASM_DIS + ['b.wasm', '-o', 'b.wast'])
+
+print '\n[ checking wasm-opt pass profiling... ]\n'
+
+wast = os.path.join(options.binaryen_test, 'emcc_hello_world.fromasm')
+delete_from_orbit('a.json')
+run_command(WASM_OPT + [wast, '-O', '--pass-profile', 'a.json'])
+profile = json.load(open('a.json'))
+assert len(profile['passes']) > 0
+for entry in profile['passes']:
+  assert entry['wallTime'] >= 0 and entry['cpuTime'] >= 0
+  if entry['pass'] == 'vacuum':
+    assert len(entry['functions']) > 0, 'function-parallel passes are profiled per function'
+    assert sum(f['nodeDelta'] for f in entry['functions']) == entry['nodeDelta']
+
+print '\n[ checking wasm-opt optimization cache... ]\n'
+
+delete_from_orbit('a.cache')
+expected = run_command(WASM_OPT + [wast, '-O', '--print'])
+cold = run_command(WASM_OPT + [wast, '-O', '--print', '--cache-dir', 'a.cache'])
+assert cold == expected, 'a cold cache does not change the output'
+assert len(os.listdir('a.cache')) > 0, 'optimized functions are stored'
+delete_from_orbit('a.json')
+warm = run_command(WASM_OPT + [wast, '-O', '--print', '--cache-dir', 'a.cache', '--pass-profile', 'a.json'])
+assert warm == expected, 'a warm cache does not change the output'
+stats = json.load(open('a.json'))['cache']
+assert stats['hits'] > 0 and stats['misses'] == 0, 'a warm cache is used for every function'
+# keys and entries are printed on the pool's threads, so check that they are
+# the same when several threads print at once
+delete_from_orbit('b.cache')
+cores = os.environ.get('BINARYEN_CORES')
+os.environ['BINARYEN_CORES'] = '4'
+try:
+  for i in range(2):
+    parallel = run_command(WASM_OPT + [wast, '-O', '--print', '--cache-dir', 'b.cache'])
+    assert parallel == expected, 'a cache used in parallel does not change the output'
+finally:
+  if cores is None:
+    del os.environ['BINARYEN_CORES']
+  else:
+    os.environ['BINARYEN_CORES'] = cores
+assert sorted(os.listdir('b.cache')) == sorted(os.listdir('a.cache')), 'the same entries are stored in parallel'
+
 print '\n[ checking wasm-opt passes... ]\n'
 
 for t in sorted(os.listdir(os.path.join(options.binaryen_test, 'passes'))):
@@ -356,6 +408,48 @@ cmd = WASM_AS + ['--validate=web', os.path.join(options.binaryen_test, 'validato
 run_command(cmd, expected_status=1)
 cmd = WASM_AS + ['--validate=none', os.path.join(options.binaryen_test, 'validator', 'invalid_return.wast')]
 run_command(cmd)
+# errors are printed on the pool's threads, so check they are the same as on
+# one thread, with float constants that are printed through shared code
+cmd = WASM_AS + [os.path.join(options.binaryen_test, 'validator', 'invalid_undropped_floats.wast')]
+errors = []
+cores = os.environ.get('BINARYEN_CORES')
+try:
+  for num in ['1', '4']:
+    os.environ['BINARYEN_CORES'] = num
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = proc.communicate()
+    assert proc.returncode == 1, 'invalid_undropped_floats.wast must not validate'
+    errors.append(err)
+finally:
+  if cores is None:
+    del os.environ['BINARYEN_CORES']
+  else:
+    os.environ['BINARYEN_CORES'] = cores
+fail_if_not_identical(errors[1], errors[0])
+
+print '\n[ checking incremental validation in pass debug mode... ]\n'
+
+# BINARYEN_PASS_DEBUG runs the passes one at a time, validating only the
+# functions each one changed, and must not change the output
+wast = os.path.join(options.binaryen_test, 'emcc_hello_world.fromasm')
+expected = run_command(WASM_OPT + [wast, '-O', '--print'])
+os.environ['BINARYEN_PASS_DEBUG'] = '1'
+try:
+  debugged = run_command(WASM_OPT + [wast, '-O', '--print'], stderr=subprocess.PIPE)
+finally:
+  del os.environ['BINARYEN_PASS_DEBUG']
+fail_if_not_identical(debugged, expected)
+# the first vacuum validates all the functions, and the second none, as it
+# changes nothing. removing an unused import changes no function either, but
+# functions are validated against the imports, so all of them are validated
+cmd = WASM_OPT + [os.path.join(options.binaryen_test, 'validator', 'incremental.wast'),
+                  '--vacuum', '--vacuum', '--remove-unused-module-elements', '--debug']
+print 'executing: ', ' '.join(cmd)
+proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+out, err = proc.communicate()
+assert proc.returncode == 0, err
+validated = [int(line.split()[2]) for line in err.split('\n') if '(validated ' in line]
+fail_if_not_identical(validated, [3, 0, 3])
 
 if options.torture and options.test_waterfall:
 
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "ast_utils.h"
 #include "support/hash.h"
 
@@ -277,40 +279,67 @@ bool ExpressionAnalyzer::flexibleEqual(Expression* left, Expression* right, Expr
 }
 
 
-// hash an expression, ignoring superficial details like specific internal names
-uint32_t ExpressionAnalyzer::hash(Expression* curr) {
-  uint32_t digest = 0;
+// hash an expression, ignoring superficial details like specific internal names.
+//
+// The hash is computed bottom-up, combining the hashes of the children into
+// that of the parent. A branch to a label defined inside the expression is
+// hashed by how many labels out it goes, and only a branch to any other
+// label by its name, so a subtree that does not branch out of itself has the
+// same hash wherever it is. Those are the subtrees we store in and look up
+// from the cache.
+uint64_t ExpressionAnalyzer::hash(Expression* curr, ExpressionHashCache* cache) {
+  // How far out a subtree branches, as the position of the outermost label
+  // in scope that it branches to plus one, or 0 if it branches to a label
+  // not defined in the expression.
+  const Index NoBranches = Index(-1);
 
-  auto hash = [&digest](uint32_t hash) {
-    digest = rehash(digest, hash);
+  // an expression whose children we are hashing
+  struct Task {
+    Expression* curr;
+    uint64_t digest; // of the contents of the expression itself
+    Index scope; // how many labels are in scope around the expression
+    Index children; // where the hashes of the children start in done
+    Index outermost;
+    bool named;
   };
-  auto hash64 = [&digest](uint64_t hash) {
-    digest = rehash(rehash(digest, hash >> 32), uint32_t(hash));
+  // a finished subtree
+  struct Done {
+    uint64_t digest;
+    Index outermost;
   };
 
+  std::vector<Task> tasks;
+  std::vector<Done> done;
   std::vector<Name> nameStack;
-  Index internalCounter = 0;
-  std::map<Name, std::vector<Index>> internalNames; // for each internal name, a vector if unique ids
-  Nop popNameMarker;
+  std::map<Name, std::vector<Index>> internalNames; // for each internal name, its positions in nameStack
+  Nop finishMarker;
   std::vector<Expression*> stack;
+  std::vector<Expression*> children;
 
+  uint64_t digest;
+  Index outermost;
+
+  auto hash = [&digest](uint64_t hash) {
+    digest = rehash64(digest, hash);
+  };
   auto noteName = [&](Name curr) {
+    hash(curr.is());
     if (curr.is()) {
+      internalNames[curr].push_back(nameStack.size());
       nameStack.push_back(curr);
-      internalNames[curr].push_back(internalCounter++);
-      stack.push_back(&popNameMarker);
     }
-    return true;
+    return curr.is();
   };
   auto hashName = [&](Name curr) {
     auto iter = internalNames.find(curr);
-    if (iter == internalNames.end()) hash64(uint64_t(curr.str));
-    else hash(iter->second.back());
-  };
-  auto popName = [&]() {
-    auto curr = nameStack.back();
-    nameStack.pop_back();
-    internalNames[curr].pop_back();
+    if (iter == internalNames.end() || iter->second.empty()) {
+      hash(uint64_t(curr.str));
+      outermost = 0;
+    } else {
+      auto position = iter->second.back();
+      hash(nameStack.size() - position);
+      outermost = std::min(outermost, position + 1);
+    }
   };
 
   stack.push_back(curr);
@@ -318,11 +347,41 @@ uint32_t ExpressionAnalyzer::hash(Expression* curr) {
   while (stack.size() > 0) {
     curr = stack.back();
     stack.pop_back();
-    if (!curr) continue;
-    if (curr == &popNameMarker) {
-      popName();
+    if (curr == &finishMarker) {
+      auto& task = tasks.back();
+      digest = task.digest;
+      outermost = task.outermost;
+      for (Index i = task.children; i < done.size(); i++) {
+        hash(done[i].digest);
+        outermost = std::min(outermost, done[i].outermost);
+      }
+      done.resize(task.children);
+      if (task.named) {
+        internalNames[nameStack.back()].pop_back();
+        nameStack.pop_back();
+      }
+      if (cache && outermost > task.scope) {
+        (*cache)[task.curr] = digest;
+      }
+      done.push_back(Done{ digest, outermost });
+      tasks.pop_back();
       continue;
     }
+    if (!curr) {
+      done.push_back(Done{ 0, NoBranches });
+      continue;
+    }
+    if (cache) {
+      auto iter = cache->find(curr);
+      if (iter != cache->end()) {
+        done.push_back(Done{ iter->second, NoBranches });
+        continue;
+      }
+    }
+    digest = 0;
+    outermost = NoBranches;
+    Index scope = nameStack.size();
+    bool named = false;
     hash(curr->_id);
     // we often don't need to hash the type, as it is tied to other values
     // we are hashing anyhow, but there are exceptions: for example, a
@@ -335,18 +394,16 @@ uint32_t ExpressionAnalyzer::hash(Expression* curr) {
     hash(curr->type);
 
     #define PUSH(clazz, what) \
-      stack.push_back(curr->cast<clazz>()->what);
+      children.push_back(curr->cast<clazz>()->what);
     #define HASH(clazz, what) \
       hash(curr->cast<clazz>()->what);
-    #define HASH64(clazz, what) \
-      hash64(curr->cast<clazz>()->what);
     #define HASH_NAME(clazz, what) \
-      hash64(uint64_t(curr->cast<clazz>()->what.str));
+      hash(uint64_t(curr->cast<clazz>()->what.str));
     #define HASH_PTR(clazz, what) \
-      hash64(uint64_t(curr->cast<clazz>()->what));
+      hash(uint64_t(curr->cast<clazz>()->what));
     switch (curr->_id) {
       case Expression::Id::BlockId: {
-        noteName(curr->cast<Block>()->name);
+        named = noteName(curr->cast<Block>()->name);
         HASH(Block, list.size());
         for (Index i = 0; i < curr->cast<Block>()->list.size(); i++) {
           PUSH(Block, list[i]);
@@ -360,7 +417,7 @@ uint32_t ExpressionAnalyzer::hash(Expression* curr) {
         break;
       }
       case Expression::Id::LoopId: {
-        noteName(curr->cast<Loop>()->name);
+        named = noteName(curr->cast<Loop>()->name);
         PUSH(Loop, body);
         break;
       }
@@ -442,7 +499,7 @@ uint32_t ExpressionAnalyzer::hash(Expression* curr) {
       }
       case Expression::Id::ConstId: {
         HASH(Const, value.type);
-        HASH64(Const, value.getBits());
+        HASH(Const, value.getBits());
         break;
       }
       case Expression::Id::UnaryId: {
@@ -489,7 +546,13 @@ uint32_t ExpressionAnalyzer::hash(Expression* curr) {
     }
     #undef HASH
     #undef PUSH
+    tasks.push_back(Task{ curr, digest, scope, Index(done.size()), outermost, named });
+    stack.push_back(&finishMarker);
+    // children are finished in order, as we pop them in reverse
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+    children.clear();
   }
-  return digest;
+  assert(done.size() == 1);
+  return done[0].digest;
 }
 } // namespace wasm
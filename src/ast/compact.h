@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef wasm_ast_compact_h
+#define wasm_ast_compact_h
+
+#include <wasm.h>
+#include <wasm-traversal.h>
+
+namespace wasm {
+
+//
+// Compacts the arena memory of a module.
+//
+// The arena never frees anything, so nodes that optimization passes
+// replace stay allocated until the module is destroyed. This copies all
+// the reachable IR into fresh arena memory, and then frees all the old
+// memory, including that of side arenas of other threads.
+//
+// The debug locations of functions are moved to the new nodes, but any
+// other Expression pointers kept from before compacting are invalid after
+// it. This must be called on the thread that created the module, while no
+// passes are running.
+//
+
+struct ArenaCompactor {
+  // arena bytes allocated before and after compacting
+  size_t bytesBefore = 0, bytesAfter = 0;
+
+  void compact(Module& wasm) {
+    bytesBefore = wasm.allocator.getAllocatedBytes();
+    // move the old memory aside, so the module's arena is empty, and new
+    // nodes are allocated into it. old nodes remain valid until we are done.
+    MixedArena old;
+    wasm.allocator.moveInto(old);
+    Relocator relocator(wasm.allocator);
+    for (auto& func : wasm.functions) {
+      relocator.relocate(func->body, &func->debugLocations);
+    }
+    for (auto& global : wasm.globals) {
+      relocator.relocate(global->init);
+    }
+    for (auto& segment : wasm.table.segments) {
+      relocator.relocate(segment.offset);
+    }
+    for (auto& segment : wasm.memory.segments) {
+      relocator.relocate(segment.offset);
+    }
+    bytesAfter = wasm.allocator.getAllocatedBytes();
+    // old is destroyed here, freeing all the old memory
+  }
+
+private:
+  // Copies each node into a new arena, in post-order, so that the children
+  // of a node have already been copied, and the pointers to them updated,
+  // by the time we copy the node itself. This scribbles on the old nodes,
+  // but they are about to be freed anyhow.
+  struct Relocator : public PostWalker<Relocator, UnifiedExpressionVisitor<Relocator>> {
+    MixedArena& allocator;
+    // the debug locations of the function being relocated, which are keyed
+    // by the old nodes, and the same locations keyed by the new ones
+    std::unordered_map<Expression*, Function::DebugLocation>* debugLocations = nullptr;
+    std::unordered_map<Expression*, Function::DebugLocation> newDebugLocations;
+
+    Relocator(MixedArena& allocator) : allocator(allocator) {}
+
+    void relocate(Expression*& root, std::unordered_map<Expression*, Function::DebugLocation>* locations = nullptr) {
+      if (locations && !locations->empty()) {
+        debugLocations = locations;
+      }
+      if (root) walk(root);
+      if (debugLocations) {
+        debugLocations->swap(newDebugLocations);
+        newDebugLocations.clear();
+        debugLocations = nullptr;
+      }
+    }
+
+    void visitExpression(Expression* curr) {
+      auto* copy = copyNode(curr);
+      if (debugLocations) {
+        auto iter = debugLocations->find(curr);
+        if (iter != debugLocations->end()) {
+          newDebugLocations[copy] = iter->second;
+        }
+      }
+      replaceCurrent(copy);
+    }
+
+    template<typename T>
+    T* copySimple(Expression* curr) {
+      auto* ret = allocator.alloc<T>();
+      *ret = *curr->cast<T>();
+      return ret;
+    }
+
+    Expression* copyNode(Expression* curr) {
+      switch (curr->_id) {
+        case Expression::BlockId: {
+          auto* old = curr->cast<Block>();
+          auto* ret = allocator.alloc<Block>();
+          ret->name = old->name;
+          ret->list.set(old->list);
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::SwitchId: {
+          auto* old = curr->cast<Switch>();
+          auto* ret = allocator.alloc<Switch>();
+          ret->targets.set(old->targets);
+          ret->default_ = old->default_;
+          ret->condition = old->condition;
+          ret->value = old->value;
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::CallId: {
+          auto* old = curr->cast<Call>();
+          auto* ret = allocator.alloc<Call>();
+          ret->operands.set(old->operands);
+          ret->target = old->target;
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::CallImportId: {
+          auto* old = curr->cast<CallImport>();
+          auto* ret = allocator.alloc<CallImport>();
+          ret->operands.set(old->operands);
+          ret->target = old->target;
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::CallIndirectId: {
+          auto* old = curr->cast<CallIndirect>();
+          auto* ret = allocator.alloc<CallIndirect>();
+          ret->operands.set(old->operands);
+          ret->fullType = old->fullType;
+          ret->target = old->target;
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::HostId: {
+          auto* old = curr->cast<Host>();
+          auto* ret = allocator.alloc<Host>();
+          ret->op = old->op;
+          ret->nameOperand = old->nameOperand;
+          ret->operands.set(old->operands);
+          ret->type = old->type;
+          return ret;
+        }
+        case Expression::IfId: return copySimple<If>(curr);
+        case Expression::LoopId: return copySimple<Loop>(curr);
+        case Expression::BreakId: return copySimple<Break>(curr);
+        case Expression::GetLocalId: return copySimple<GetLocal>(curr);
+        case Expression::SetLocalId: return copySimple<SetLocal>(curr);
+        case Expression::GetGlobalId: return copySimple<GetGlobal>(curr);
+        case Expression::SetGlobalId: return copySimple<SetGlobal>(curr);
+        case Expression::LoadId: return copySimple<Load>(curr);
+        case Expression::StoreId: return copySimple<Store>(curr);
+        case Expression::ConstId: return copySimple<Const>(curr);
+        case Expression::UnaryId: return copySimple<Unary>(curr);
+        case Expression::BinaryId: return copySimple<Binary>(curr);
+        case Expression::SelectId: return copySimple<Select>(curr);
+        case Expression::DropId: return copySimple<Drop>(curr);
+        case Expression::ReturnId: return copySimple<Return>(curr);
+        case Expression::NopId: return copySimple<Nop>(curr);
+        case Expression::UnreachableId: return copySimple<Unreachable>(curr);
+        default: WASM_UNREACHABLE();
+      }
+    }
+  };
+};
+
+} // namespace wasm
+
+#endif // wasm_ast_compact_h
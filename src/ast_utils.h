@@ -17,6 +17,8 @@
 #ifndef wasm_ast_utils_h
 #define wasm_ast_utils_h
 
+#include <unordered_map>
+
 #include "wasm.h"
 #include "wasm-traversal.h"
 #include "wasm-builder.h"
@@ -345,7 +347,24 @@ struct ExpressionAnalyzer {
   }
 
   // hash an expression, ignoring superficial details like specific internal names
-  static uint32_t hash(Expression* curr);
+  static uint64_t hash(Expression* curr) {
+    return hash(curr, nullptr);
+  }
+
+private:
+  // A side table of subtree hashes, which hash() fills in and reuses, so
+  // hashing an expression again, or one containing it, does not rehash the
+  // subtrees it has already seen. Only subtrees that do not branch out of
+  // themselves are stored, as their hashes do not depend on where they are.
+  // Code that modifies a subtree in place must erase it and its parents.
+  // Walkers do not know the parents of what they replace, so this cannot
+  // be done for them, and only LocalCSE, which tracks the parents itself,
+  // uses a cache.
+  typedef std::unordered_map<Expression*, uint64_t> ExpressionHashCache;
+
+  static uint64_t hash(Expression* curr, ExpressionHashCache* cache);
+
+  friend struct LocalCSE;
 };
 
 // Finalizes a node
@@ -22,6 +22,7 @@
 
 #include "binaryen-c.h"
 #include "pass.h"
+#include "ast/compact.h"
 #include "wasm.h"
 #include "wasm-binary.h"
 #include "wasm-builder.h"
@@ -875,6 +876,17 @@ void BinaryenModuleAutoDrop(BinaryenModuleRef module) {
   passRunner.run();
 }
 
+size_t BinaryenModuleCompact(BinaryenModuleRef module) {
+  if (tracing) {
+    std::cout << "  BinaryenModuleCompact(the_module);\n";
+  }
+
+  Module* wasm = (Module*)module;
+  ArenaCompactor compactor;
+  compactor.compact(*wasm);
+  return compactor.bytesBefore - compactor.bytesAfter;
+}
+
 size_t BinaryenModuleWrite(BinaryenModuleRef module, char* output, size_t outputSize) {
   if (tracing) {
     std::cout << "  // BinaryenModuleWrite\n";
@@ -372,6 +372,13 @@ void BinaryenModuleOptimize(BinaryenModuleRef module);
 // but simpler to use autodrop).
 void BinaryenModuleAutoDrop(BinaryenModuleRef module);
 
+// Reclaim the memory of expressions that are no longer used, for example
+// ones that optimizations replaced. This copies all the module's expressions
+// into new memory and frees the old, so any BinaryenExpressionRefs into the
+// module that you kept from before are invalid after this.
+// @return how many bytes of memory were reclaimed
+size_t BinaryenModuleCompact(BinaryenModuleRef module);
+
 // Serialize a module into binary form.
 // @return how many bytes were written. This will be less than or equal to outputSize
 size_t BinaryenModuleWrite(BinaryenModuleRef module, char* output, size_t outputSize);
@@ -19,9 +19,11 @@
 #ifndef wasm_istring_h
 #define wasm_istring_h
 
+#include <mutex>
 #include <unordered_set>
 #include <unordered_map>
 #include <set>
+#include <vector>
 
 #include <string.h>
 #include <stdint.h>
@@ -29,8 +31,6 @@
 #include <stdio.h>
 #include <assert.h>
 
-#include "support/threads.h"
-
 namespace cashew {
 
 struct IString {
@@ -65,27 +65,7 @@ struct IString {
   }
 
   void set(const char *s, bool reuse=true) {
-    typedef std::unordered_set<const char *, CStringHash, CStringEqual> StringSet;
-    static StringSet* strings = new StringSet();
-
-    auto existing = strings->find(s);
-
-    if (existing == strings->end()) {
-      // the StringSet cache is a global shared structure, which should
-      // not be modified by multiple threads at once.
-      assert(!wasm::ThreadPool::isRunning());
-      if (!reuse) {
-        size_t len = strlen(s) + 1;
-        char *copy = (char*)malloc(len); // XXX leaked
-        strncpy(copy, s, len);
-        s = copy;
-      }
-      strings->insert(s);
-    } else {
-      s = *existing;
-    }
-
-    str = s;
+    str = intern(s, reuse);
   }
 
   void set(const IString &s) {
@@ -121,6 +101,94 @@ struct IString {
 
   bool is() const     { return str != nullptr; }
   bool isNull() const { return str == nullptr; }
+
+private:
+  // The global table of interned strings. It is split into shards by hash,
+  // each with its own lock, so that threads can intern strings at the same
+  // time, and each thread also has a small cache of strings it recently
+  // interned, which finds repeated strings without taking any lock. The
+  // hash is computed once, and stored with the strings in the table.
+  //
+  // When strings are not reused, copies of them are allocated in chunks
+  // owned by the table, which live as long as the process.
+
+  struct Entry {
+    size_t hash;
+    const char *str;
+  };
+  struct EntryHash {
+    size_t operator()(const Entry& entry) const {
+      return entry.hash;
+    }
+  };
+  struct EntryEqual {
+    bool operator()(const Entry& x, const Entry& y) const {
+      return x.hash == y.hash && strcmp(x.str, y.str) == 0;
+    }
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_set<Entry, EntryHash, EntryEqual> strings;
+    std::vector<char*> chunks;
+    size_t index = 0; // in the last chunk
+
+    const char* copy(const char* s) {
+      static const size_t ChunkSize = 32768;
+      size_t len = strlen(s) + 1;
+      if (len > ChunkSize / 4) {
+        // big strings get a chunk of their own, leaving the current one
+        // to be filled by small ones
+        chunks.insert(chunks.begin(), new char[len]);
+        memcpy(chunks.front(), s, len);
+        return chunks.front();
+      }
+      if (chunks.empty() || index + len > ChunkSize) {
+        chunks.push_back(new char[ChunkSize]);
+        index = 0;
+      }
+      char* ret = chunks.back() + index;
+      memcpy(ret, s, len);
+      index += len;
+      return ret;
+    }
+  };
+
+  static const size_t NumShards = 64;
+  static const size_t ThreadCacheSize = 1024;
+
+  static Shard* getShards() {
+    static Shard* shards = new Shard[NumShards]; // never freed, strings must outlive everything
+    return shards;
+  }
+
+  static const char** getThreadCache() {
+    static thread_local const char* cache[ThreadCacheSize] = {};
+    return cache;
+  }
+
+  static const char *intern(const char *s, bool reuse) {
+    size_t hash = hash_c(s);
+    // fast path: strings this thread interned recently
+    auto& cached = getThreadCache()[hash % ThreadCacheSize];
+    if (cached && strcmp(cached, s) == 0) {
+      return cached;
+    }
+    auto& shard = getShards()[(hash >> 10) % NumShards];
+    const char *ret;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto existing = shard.strings.find(Entry{ hash, s });
+      if (existing != shard.strings.end()) {
+        ret = existing->str;
+      } else {
+        ret = reuse ? s : shard.copy(s);
+        shard.strings.insert(Entry{ hash, ret });
+      }
+    }
+    cached = ret;
+    return ret;
+  }
 };
 
 } // namespace cashew
@@ -92,7 +92,19 @@ class ArrayStorage : public ArenaVectorBase<ArrayStorage, Ref> {
 public:
   void allocate(size_t size) {
     allocatedElements = size;
-    data = static_cast<Ref*>(arena.allocSpace(sizeof(Ref) * allocatedElements));
+    data = static_cast<Ref*>(arena.allocReusableSpace(sizeof(Ref) * allocatedElements));
+  }
+
+  bool grow(size_t size) {
+    if (!arena.growSpace(data, sizeof(Ref) * allocatedElements, sizeof(Ref) * size)) {
+      return false;
+    }
+    allocatedElements = size;
+    return true;
+  }
+
+  void release(Ref* old, size_t size) {
+    arena.freeSpace(old, sizeof(Ref) * size);
   }
 };
 
@@ -543,15 +555,16 @@ struct JSPrinter {
     // try to emit the fewest necessary characters
     bool integer = fmod(d, 1) == 0;
     #define BUFFERSIZE 1000
-    static char full_storage_f[BUFFERSIZE], full_storage_e[BUFFERSIZE]; // f is normal, e is scientific for float, x for integer
-    static char *storage_f = full_storage_f + 1, *storage_e = full_storage_e + 1; // full has one more char, for a possible '-'
+    // per thread, so numbers can be printed on several threads at once
+    thread_local char full_storage_f[BUFFERSIZE], full_storage_e[BUFFERSIZE]; // f is normal, e is scientific for float, x for integer
+    char *storage_f = full_storage_f + 1, *storage_e = full_storage_e + 1; // full has one more char, for a possible '-'
     auto err_f = std::numeric_limits<double>::quiet_NaN();
     auto err_e = std::numeric_limits<double>::quiet_NaN();
     for (int e = 0; e <= 1; e++) {
       char *buffer = e ? storage_e : storage_f;
       double temp;
       if (!integer) {
-        static char format[6];
+        char format[6];
         for (int i = 0; i <= 18; i++) {
           format[0] = '%';
           format[1] = '.';
@@ -804,6 +804,9 @@
     this['autoDrop'] = function() {
       return Module['_BinaryenModuleAutoDrop'](module);
     };
+    this['compact'] = function() {
+      return Module['_BinaryenModuleCompact'](module);
+    };
 
     // TODO: fix this hard-wired limit
     var MAX = 1024*1024;
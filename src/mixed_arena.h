@@ -62,8 +62,23 @@ struct MixedArena {
   size_t chunkSize = 32768;
   size_t index; // in last chunk
 
+  // the number of bytes allocated in this arena (not counting side
+  // arenas). this is only modified on the arena's own thread.
+  size_t allocatedBytes = 0;
+
+  // memory that was released by its users, and can be reused, in lists by
+  // size class: list i contains blocks of at least 2^i bytes. the first
+  // word of each free block points to the next one.
+  static const size_t NumSizeClasses = 32;
+  static const size_t MinSizeClass = 4; // blocks must fit the next pointer
+  void* freeLists[NumSizeClasses] = {};
+
   std::thread::id threadId;
 
+  // a unique id for this arena, which is never reused, so that the
+  // thread-local cache of arenas can never match a destroyed arena
+  uint64_t id;
+
   // multithreaded allocation - each arena is valid on a specific thread.
   // if we are on the wrong thread, we atomically look in the linked
   // list of next, adding an allocator if necessary
@@ -71,54 +86,86 @@ struct MixedArena {
 
   MixedArena() {
     threadId = std::this_thread::get_id();
+    id = getNextId();
     next.store(nullptr);
   }
 
+  // Get the arena the current thread should allocate in: this one if we
+  // are on its original thread, or a side arena otherwise. The answer is
+  // cached per thread, so after the first call on a thread this is just
+  // a thread-local load and a comparison.
+  MixedArena& getArenaForThisThread() {
+    auto& cache = getThreadCache();
+    if (cache.id == id) {
+      return *cache.arena;
+    }
+    auto* arena = findArenaForThisThread();
+    cache.id = id;
+    cache.arena = arena;
+    return *arena;
+  }
+
   void* allocSpace(size_t size) {
-    // the bump allocator data should not be modified by multiple threads at once.
-    auto myId = std::this_thread::get_id();
-    if (myId != threadId) {
-      MixedArena* curr = this;
-      MixedArena* allocated = nullptr;
-      while (myId != curr->threadId) {
-        auto seen = curr->next.load();
-        if (seen) {
-          curr = seen;
-          continue;
-        }
-        // there is a nullptr for next, so we may be able to place a new
-        // allocator for us there. but carefully, as others may do so as
-        // well. we may waste a few allocations here, but it doesn't matter
-        // as this can only happen as the chain is built up, i.e.,
-        // O(# of cores) per allocator, and our allocatrs are long-lived.
-        if (!allocated) {
-          allocated = new MixedArena(); // has our thread id
-        }
-        if (curr->next.compare_exchange_weak(seen, allocated)) {
-          // we replaced it, so we are the next in the chain
-          // we can forget about allocated, it is owned by the chain now
-          allocated = nullptr;
-          break;
-        }
-        // otherwise, the cmpxchg updated seen, and we continue to loop
-        curr = seen;
+    return getArenaForThisThread().bump(size);
+  }
+
+  // Allocate space that may be reused memory that was freed with freeSpace().
+  // This is meant for buffers that grow, like those of ArenaVectors, which
+  // are abandoned as they grow, while allocSpace() is the fastest path for
+  // things that are never freed.
+  void* allocReusableSpace(size_t size) {
+    auto& arena = getArenaForThisThread();
+    auto sizeClass = getSizeClassAtLeast(size);
+    if (sizeClass < NumSizeClasses) {
+      auto*& list = arena.freeLists[sizeClass];
+      if (list) {
+        auto* ret = list;
+        list = *static_cast<void**>(list);
+        return ret;
       }
-      if (allocated) delete allocated;
-      return curr->allocSpace(size);
     }
-    size = (size + 7) & (-8); // same alignment as malloc TODO optimize?
-    bool mustAllocate = false;
-    while (chunkSize <= size) {
-      chunkSize *= 2;
-      mustAllocate = true;
+    return arena.bump(size);
+  }
+
+  // Try to grow some space in place, which is possible if it is the last
+  // allocation made in the current thread's arena, and the current chunk
+  // has room. Returns whether we succeeded.
+  bool growSpace(void* data, size_t oldSize, size_t newSize) {
+    auto& arena = getArenaForThisThread();
+    oldSize = align(oldSize);
+    newSize = align(newSize);
+    assert(newSize >= oldSize);
+    if (arena.chunks.size() == 0 ||
+        static_cast<char*>(data) + oldSize != arena.chunks.back() + arena.index) {
+      return false; // not the last allocation
     }
-    if (chunks.size() == 0 || index + size >= chunkSize || mustAllocate) {
-      chunks.push_back(new char[chunkSize]);
-      index = 0;
+    auto extra = newSize - oldSize;
+    if (arena.index + extra >= arena.chunkSize) {
+      return false; // no room
     }
-    auto* ret = chunks.back() + index;
-    index += size;
-    return static_cast<void*>(ret);
+    arena.index += extra;
+    arena.allocatedBytes += extra;
+    return true;
+  }
+
+  // Note that some space is no longer used, so that allocReusableSpace()
+  // can reuse it later. The memory is not returned to the system, and
+  // remains owned by the arena.
+  void freeSpace(void* data, size_t size) {
+    auto sizeClass = getSizeClassAtMost(size);
+    if (sizeClass < MinSizeClass || sizeClass >= NumSizeClasses) return;
+    auto*& list = getArenaForThisThread().freeLists[sizeClass];
+    *static_cast<void**>(data) = list;
+    list = data;
+  }
+
+  // The total number of bytes allocated in this arena and its side arenas.
+  size_t getAllocatedBytes() {
+    size_t total = 0;
+    for (auto* curr = this; curr; curr = curr->next.load()) {
+      total += curr->allocatedBytes;
+    }
+    return total;
   }
 
   template<class T>
@@ -128,17 +175,134 @@ struct MixedArena {
     return ret;
   }
 
+  // Move all the memory of this arena, including its side arenas, into
+  // another arena, leaving this one empty but still usable. Things that
+  // were allocated here remain valid until the other arena is destroyed.
+  // This must be called on the arena's own thread, while no other thread
+  // allocates in it.
+  void moveInto(MixedArena& other) {
+    assert(std::this_thread::get_id() == threadId);
+    other.clear();
+    if (other.next.load()) delete other.next.load();
+    other.chunks.swap(chunks);
+    other.chunkSize = chunkSize;
+    other.index = index;
+    other.allocatedBytes = allocatedBytes;
+    other.next.store(next.exchange(nullptr));
+    allocatedBytes = 0;
+    // free memory is in the old chunks
+    for (size_t i = 0; i < NumSizeClasses; i++) {
+      other.freeLists[i] = freeLists[i];
+      freeLists[i] = nullptr;
+    }
+    // our side arenas now belong to the other arena, so use a new id, which
+    // makes any thread-local caches of them miss
+    id = getNextId();
+  }
+
   void clear() {
     for (char* chunk : chunks) {
       delete[] chunk;
     }
     chunks.clear();
+    for (auto*& list : freeLists) {
+      list = nullptr;
+    }
   }
 
   ~MixedArena() {
     clear();
     if (next.load()) delete next.load();
   }
+
+private:
+  struct ThreadCache {
+    uint64_t id = 0;
+    MixedArena* arena = nullptr;
+  };
+
+  static ThreadCache& getThreadCache() {
+    static thread_local ThreadCache cache;
+    return cache;
+  }
+
+  static uint64_t getNextId() {
+    static std::atomic<uint64_t> nextId(1);
+    return nextId.fetch_add(1);
+  }
+
+  MixedArena* findArenaForThisThread() {
+    auto myId = std::this_thread::get_id();
+    MixedArena* curr = this;
+    MixedArena* allocated = nullptr;
+    while (myId != curr->threadId) {
+      auto seen = curr->next.load();
+      if (seen) {
+        curr = seen;
+        continue;
+      }
+      // there is a nullptr for next, so we may be able to place a new
+      // allocator for us there. but carefully, as others may do so as
+      // well. we may waste a few allocations here, but it doesn't matter
+      // as this can only happen as the chain is built up, i.e.,
+      // O(# of cores) per allocator, and our allocatrs are long-lived.
+      if (!allocated) {
+        allocated = new MixedArena(); // has our thread id
+      }
+      if (curr->next.compare_exchange_strong(seen, allocated)) {
+        // we replaced it, so we are the next in the chain
+        // we can forget about allocated, it is owned by the chain now
+        curr = allocated;
+        allocated = nullptr;
+        break;
+      }
+      // otherwise, the cmpxchg updated seen, and we continue to loop
+      curr = seen;
+    }
+    if (allocated) delete allocated;
+    return curr;
+  }
+
+  static size_t align(size_t size) {
+    return (size + 7) & (-8); // same alignment as malloc TODO optimize?
+  }
+
+  // The smallest size class whose blocks are all big enough for a size.
+  static size_t getSizeClassAtLeast(size_t size) {
+    size_t sizeClass = MinSizeClass;
+    while (sizeClass < NumSizeClasses && (size_t(1) << sizeClass) < size) {
+      sizeClass++;
+    }
+    return sizeClass;
+  }
+
+  // The largest size class that a block of a size fits in.
+  static size_t getSizeClassAtMost(size_t size) {
+    size_t sizeClass = 0;
+    while (sizeClass + 1 < NumSizeClasses && (size_t(1) << (sizeClass + 1)) <= size) {
+      sizeClass++;
+    }
+    return sizeClass;
+  }
+
+  // the bump allocator data should not be modified by multiple threads at
+  // once, so this must only be called on the arena's own thread.
+  void* bump(size_t size) {
+    size = align(size);
+    bool mustAllocate = false;
+    while (chunkSize <= size) {
+      chunkSize *= 2;
+      mustAllocate = true;
+    }
+    if (chunks.size() == 0 || index + size >= chunkSize || mustAllocate) {
+      chunks.push_back(new char[chunkSize]);
+      index = 0;
+    }
+    auto* ret = chunks.back() + index;
+    index += size;
+    allocatedBytes += size;
+    return static_cast<void*>(ret);
+  }
 };
 
 
@@ -151,15 +315,23 @@ template <typename SubType, typename T>
 class ArenaVectorBase {
 protected:
   T* data = nullptr;
-  size_t usedElements = 0,
-         allocatedElements = 0;
+  // 32-bit sizes keep the vectors, and the nodes that contain them, small
+  uint32_t usedElements = 0,
+           allocatedElements = 0;
 
   void reallocate(size_t size) {
     T* old = data;
+    size_t oldAllocated = allocatedElements;
+    if (old && static_cast<SubType*>(this)->grow(size)) {
+      return; // grown in place, nothing to copy
+    }
     static_cast<SubType*>(this)->allocate(size);
     for (size_t i = 0; i < usedElements; i++) {
       data[i] = old[i];
     }
+    if (old) {
+      static_cast<SubType*>(this)->release(old, oldAllocated);
+    }
   }
 
 public:
@@ -216,7 +388,12 @@ public:
   void set(const ListType& list) {
     size_t size = list.size();
     if (allocatedElements < size) {
+      T* old = data;
+      size_t oldAllocated = allocatedElements;
       static_cast<SubType*>(this)->allocate(size);
+      if (old) {
+        static_cast<SubType*>(this)->release(old, oldAllocated);
+      }
     }
     for (size_t i = 0; i < size; i++) {
       data[i] = list[i];
@@ -268,9 +445,18 @@ public:
   void allocate(size_t size) {
     abort(); // must be implemented in children
   }
+
+  // Children can implement these to grow in place, and to allow reuse of
+  // buffers that were abandoned when growing.
+  bool grow(size_t size) {
+    return false;
+  }
+  void release(T* old, size_t size) {}
 };
 
-// A vector that has an allocator for arena allocation
+// A vector that has an allocator for arena allocation. When it grows, it
+// first tries to grow in place, and otherwise it lets the arena reuse the
+// buffer it abandons, so building long lists does not leak arena space.
 //
 // TODO: consider not saving the allocator, but requiring it be
 //       passed in when needed, would make this (and thus Blocks etc.
@@ -290,7 +476,19 @@ public:
 
   void allocate(size_t size) {
     this->allocatedElements = size;
-    this->data = static_cast<T*>(allocator.allocSpace(sizeof(T) * this->allocatedElements));
+    this->data = static_cast<T*>(allocator.allocReusableSpace(sizeof(T) * this->allocatedElements));
+  }
+
+  bool grow(size_t size) {
+    if (!allocator.growSpace(this->data, sizeof(T) * this->allocatedElements, sizeof(T) * size)) {
+      return false;
+    }
+    this->allocatedElements = size;
+    return true;
+  }
+
+  void release(T* old, size_t size) {
+    allocator.freeSpace(old, sizeof(T) * size);
   }
 };
 
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2017 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// An on-disk cache of optimized functions, to make re-optimizing a module
+// that changed only a little faster. When PassRunner runs a stack of
+// function-parallel passes on a function that it already optimized with
+// the same passes and options before (in this or an earlier run), it
+// replaces the function's contents with the cached result instead of
+// running the passes.
+//
+// The key of an entry is the function in text format, together with the
+// signatures of everything it refers to in the module, the names of the
+// passes and the pass options. A hash of the key picks the file of the
+// entry in the cache directory, and the file contains the full key too,
+// so a hash collision is just a miss.
+//
+// Functions with debug locations are not cached, as the text format does
+// not preserve them.
+//
+
+#ifndef wasm_optimization_cache_h
+#define wasm_optimization_cache_h
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "wasm.h"
+#include "pass.h"
+
+namespace wasm {
+
+class OptimizationCache {
+  std::string directory;
+  uint64_t nonce; // makes our temporary file names unique
+  std::atomic<size_t> tempCounter;
+  std::atomic<size_t> hits;
+  std::atomic<size_t> misses;
+
+public:
+  // The directory is created if it does not exist.
+  OptimizationCache(std::string directory);
+
+  // Returns the key for running the passes on the function, or an empty
+  // string if the function cannot be cached. This, load and store are
+  // called on the pool's threads, for different functions at once, so the
+  // printing they do must not share state between threads.
+  std::string getKey(const std::vector<Pass*>& passes, const PassOptions& options, Module* module, Function* func);
+
+  // If there is an entry for the key, replaces the function's locals and
+  // body with the cached ones, and returns true.
+  bool load(const std::string& key, Module* module, Function* func);
+
+  // Saves the function as the result for the key.
+  void store(const std::string& key, Module* module, Function* func);
+
+  // How many loads found an entry and how many did not, so far. PassRunner
+  // reports them in its profile.
+  size_t getHits() { return hits; }
+  size_t getMisses() { return misses; }
+
+private:
+  std::string getPath(const std::string& key);
+};
+
+} // namespace wasm
+
+#endif // wasm_optimization_cache_h
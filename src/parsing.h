@@ -18,6 +18,7 @@
 #define wasm_parsing_h
 
 #include <cmath>
+#include <cstring>
 #include <ostream>
 #include <sstream>
 #include <string>
@@ -32,12 +33,13 @@
 
 namespace wasm {
 
-inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allocator) {
-  const char *str = s.str;
+// The text does not need to be interned, so this can be called on a string
+// that is not going to be used as a name.
+inline Expression* parseConst(const char* str, WasmType type, MixedArena& allocator) {
   auto ret = allocator.alloc<Const>();
   ret->type = type;
   if (isWasmTypeFloat(type)) {
-    if (s == _INFINITY) {
+    if (!strcmp(str, _INFINITY.str)) {
       switch (type) {
         case f32: ret->value = Literal(std::numeric_limits<float>::infinity()); break;
         case f64: ret->value = Literal(std::numeric_limits<double>::infinity()); break;
@@ -46,7 +48,7 @@ inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allo
       //std::cerr << "make constant " << str << " ==> " << ret->value << '\n';
       return ret;
     }
-    if (s == NEG_INFINITY) {
+    if (!strcmp(str, NEG_INFINITY.str)) {
       switch (type) {
         case f32: ret->value = Literal(-std::numeric_limits<float>::infinity()); break;
         case f64: ret->value = Literal(-std::numeric_limits<double>::infinity()); break;
@@ -55,7 +57,7 @@ inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allo
       //std::cerr << "make constant " << str << " ==> " << ret->value << '\n';
       return ret;
     }
-    if (s == _NAN) {
+    if (!strcmp(str, _NAN.str)) {
       switch (type) {
         case f32: ret->value = Literal(float(std::nan(""))); break;
         case f64: ret->value = Literal(double(std::nan(""))); break;
@@ -108,7 +110,7 @@ inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allo
       //std::cerr << "make constant " << str << " ==> " << ret->value << '\n';
       return ret;
     }
-    if (s == NEG_NAN) {
+    if (!strcmp(str, NEG_NAN.str)) {
       switch (type) {
         case f32: ret->value = Literal(float(-std::nan(""))); break;
         case f64: ret->value = Literal(double(-std::nan(""))); break;
@@ -168,6 +170,10 @@ inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allo
   return ret;
 }
 
+inline Expression* parseConst(cashew::IString s, WasmType type, MixedArena& allocator) {
+  return parseConst(s.str, type, allocator);
+}
+
 struct ParseException {
   std::string text;
   size_t line, col;
@@ -61,8 +61,49 @@ struct PassOptions {
   int optimizeLevel = 0; // 0, 1, 2 correspond to -O0, -O1, -O2, etc.
   int shrinkLevel = 0;   // 0, 1, 2 correspond to -O0, -Os, -Oz
   bool ignoreImplicitTraps = false; // optimize assuming things like div by 0, bad load/store, will not trap
+  int learningTimeBudget = 0; // milliseconds that learning passes may search for on each function, or 0 for no limit
 };
 
+//
+// Profiling data from running passes, see PassRunner::setProfile. Each entry
+// has the wall and CPU time spent, the bytes allocated in the module's arenas,
+// and the change in the number of nodes in function bodies.
+//
+struct PassProfile {
+  struct Entry {
+    double wallTime = 0;
+    double cpuTime = 0;
+    size_t allocatedBytes = 0;
+    int64_t nodeDelta = 0;
+  };
+
+  struct PassEntry {
+    std::string pass;
+    // For a function-parallel pass, the sum of the entries of the functions,
+    // which may have run on several threads at once. Otherwise, measured
+    // for the pass as a whole, with the CPU time of all threads.
+    Entry total;
+    // For function-parallel passes, one entry per function
+    std::vector<Name> functionNames;
+    std::vector<Entry> functions;
+
+    void sumFunctions();
+  };
+
+  // in the order they were run
+  std::vector<PassEntry> passes;
+
+  // With an optimization cache, how many times running a stack of passes on
+  // a function was replaced by a cached result, and how many times it was not
+  size_t cacheHits = 0;
+  size_t cacheMisses = 0;
+
+  void dumpJSON(std::ostream& o);
+  void dumpCSV(std::ostream& o);
+};
+
+class OptimizationCache;
+
 //
 // Runs a set of passes, in order
 //
@@ -83,20 +124,27 @@ struct PassRunner {
     options.validateGlobally = validate;
   }
 
+  // Record profiling data in the given profile while running. This does not
+  // change how the passes are scheduled. Nested runners are not profiled.
+  void setProfile(PassProfile* profile_) {
+    profile = profile_;
+  }
+
+  // Use an on-disk cache of optimized functions when running function-parallel
+  // passes, see optimization-cache.h. Nested runners do not use it.
+  void setCache(OptimizationCache* cache_) {
+    cache = cache_;
+  }
+
   void add(std::string passName) {
     auto pass = PassRegistry::get()->createPass(passName);
     if (!pass) Fatal() << "Could not find pass: " << passName << "\n";
     doAdd(pass);
   }
 
-  template<class P>
-  void add() {
-    doAdd(new P());
-  }
-
-  template<class P, class Arg>
-  void add(Arg arg){
-    doAdd(new P(arg));
+  template<class P, class... Args>
+  void add(Args... args) {
+    doAdd(new P(args...));
   }
 
   // Adds the default set of optimization passes; this is
@@ -125,7 +173,9 @@ struct PassRunner {
 
   // When running a pass runner within another pass runner, this
   // flag should be set. This influences how pass debugging works,
-  // and may influence other things in the future too.
+  // and may influence other things in the future too. Nested runners
+  // may be run from inside the ThreadPool's threads, in which case their
+  // function-parallel work is run as nested tasks in the pool.
   void setIsNested(bool nested) {
     isNested = nested;
   }
@@ -136,7 +186,22 @@ protected:
 private:
   void doAdd(Pass* pass);
 
-  void runPassOnFunction(Pass* pass, Function* func);
+  PassProfile* profile = nullptr;
+  OptimizationCache* cache = nullptr;
+
+  // Runs a non-function-parallel pass on the whole module
+  void runPassOnModule(Pass* pass);
+
+  // If entry is provided, the run is profiled into it
+  void runPassOnFunction(Pass* pass, Function* func, PassProfile::Entry* entry = nullptr);
+
+  // Adds an entry to the profile, with entries for all functions if
+  // the pass is function-parallel, and returns its index
+  size_t addProfileEntry(Pass* pass);
+
+  // The bytes allocated so far in the module's arena, and in each of its
+  // side arenas, one per thread that allocated.
+  std::vector<size_t> getAllocatedBytesPerThread();
 };
 
 //
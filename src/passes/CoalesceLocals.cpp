@@ -23,7 +23,9 @@
 
 
 #include <algorithm>
+#include <chrono>
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "wasm.h"
@@ -31,23 +33,88 @@
 #include "ast_utils.h"
 #include "cfg/cfg-traversal.h"
 #include "wasm-builder.h"
+#include "support/bits.h"
 #include "support/learning.h"
+#include "support/sparse_square_matrix.h"
 #ifdef CFG_PROFILE
 #include "support/timing.h"
 #endif
 
 namespace wasm {
 
-// A set of locals. This is optimized for comparisons,
-// mergings, and iteration on elements, assuming that there
-// may be a great many potential elements but actual sets
-// may be fairly small. Specifically, we use a sorted
-// vector.
-struct LocalSet : std::vector<Index> {
-  LocalSet() {}
+// Sets of locals, used for liveness. These are optimized for comparisons,
+// mergings, and iteration on elements. Which representation is best
+// depends on the number of locals: with few, a dense bitset is compact and
+// merges quickly, while with a great many potential elements (asm2wasm
+// output can have tens of thousands) but fairly small actual sets, a sorted
+// vector is better. Both provide the same interface, and iterate in
+// increasing order.
 
-  LocalSet merge(const LocalSet& other) const {
-    LocalSet ret;
+struct DenseLocalSet {
+  std::vector<uint64_t> words;
+
+  DenseLocalSet(Index numLocals) : words((numLocals + 63) / 64) {}
+
+  void merge(const DenseLocalSet& other) {
+    assert(words.size() == other.words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      words[i] |= other.words[i];
+    }
+  }
+
+  void insert(Index x) {
+    words[x / 64] |= uint64_t(1) << (x % 64);
+  }
+
+  bool erase(Index x) {
+    auto& word = words[x / 64];
+    auto bit = uint64_t(1) << (x % 64);
+    if (!(word & bit)) return false;
+    word &= ~bit;
+    return true;
+  }
+
+  bool has(Index x) const {
+    return (words[x / 64] >> (x % 64)) & 1;
+  }
+
+  Index size() const {
+    Index ret = 0;
+    for (auto word : words) ret += PopCount(word);
+    return ret;
+  }
+
+  template<typename T>
+  void forEach(T func) const {
+    for (size_t i = 0; i < words.size(); i++) {
+      auto word = words[i];
+      while (word) {
+        func(Index(i * 64 + CountTrailingZeroes(word)));
+        word &= word - 1;
+      }
+    }
+  }
+
+  bool operator==(const DenseLocalSet& other) const { return words == other.words; }
+  bool operator!=(const DenseLocalSet& other) const { return words != other.words; }
+
+  void dump(const char* str = nullptr) const {
+    std::cout << "LocalSet " << (str ? str : "") << ": ";
+    forEach([](Index x) { std::cout << x << " "; });
+    std::cout << '\n';
+  }
+};
+
+struct SortedLocalSet : std::vector<Index> {
+  SortedLocalSet(Index numLocals) {}
+
+  void merge(const SortedLocalSet& other) {
+    if (other.empty()) return;
+    if (empty()) {
+      *this = other;
+      return;
+    }
+    SortedLocalSet ret(0);
     ret.resize(size() + other.size());
     Index i = 0, j = 0, t = 0;
     while (i < size() && j < other.size()) {
@@ -74,7 +141,7 @@ struct LocalSet : std::vector<Index> {
       j++;
     }
     ret.resize(t);
-    return ret;
+    swap(ret);
   }
 
   void insert(Index x) {
@@ -98,11 +165,16 @@ struct LocalSet : std::vector<Index> {
     return false;
   }
 
-  bool has(Index x) {
+  bool has(Index x) const {
     auto it = std::lower_bound(begin(), end(), x);
     return it != end() && *it == x;
   }
 
+  template<typename T>
+  void forEach(T func) const {
+    for (auto x : *this) func(x);
+  }
+
   void verify() const {
     for (Index i = 1; i < size(); i++) {
       assert((*this)[i - 1] < (*this)[i]);
@@ -116,6 +188,9 @@ struct LocalSet : std::vector<Index> {
   }
 };
 
+// we use dense sets of live locals up to this many locals
+static const Index DenseLivenessLimit = 2048;
+
 // a liveness-relevant action
 struct Action {
   enum What {
@@ -132,9 +207,10 @@ struct Action {
   bool isSet() { return what == Set; }
 };
 
-// information about liveness in a basic block
+// information about liveness in a basic block. the live locals at its start
+// and end are kept by LivenessFlow, which finds them for the block's index.
 struct Liveness {
-  LocalSet start, end; // live locals at the start and end
+  Index index; // the index of the block
   std::vector<Action> actions; // actions occurring in this block
 
   void dump(Function* func) {
@@ -146,6 +222,168 @@ struct Liveness {
   }
 };
 
+// The interference graph. Unless there are very many locals this is a dense,
+// symmetric bit matrix, whose rows are bitsets like DenseLocalSet, so that
+// making all the locals in a set interfere with each other takes a few word
+// operations per local, and a local's interferences can be iterated quickly.
+// With very many locals we store just the actual interferences.
+struct InterferenceGraph {
+  // dense graphs have up to this many bits
+  static const uint64_t DenseLimit = uint64_t(512) << 20;
+
+  Index numLocals;
+  bool dense;
+  size_t wordsPerRow;
+  std::vector<uint64_t> rows;
+  SparseSquareMatrix<bool> sparse;
+  std::vector<uint64_t> mask; // a row-sized scratch bitset
+  std::vector<Index> scratch;
+
+  void recreate(Index num) {
+    numLocals = num;
+    dense = uint64_t(num) * num <= DenseLimit;
+    wordsPerRow = (num + 63) / 64;
+    rows.clear();
+    mask.clear();
+    if (dense) {
+      rows.resize(num * wordsPerRow);
+      mask.resize(wordsPerRow);
+      sparse.recreate(0);
+    } else {
+      sparse.recreate(num);
+    }
+  }
+
+  void add(Index i, Index j) {
+    if (i == j) return;
+    if (dense) {
+      rows[i * wordsPerRow + j / 64] |= uint64_t(1) << (j % 64);
+      rows[j * wordsPerRow + i / 64] |= uint64_t(1) << (i % 64);
+    } else {
+      sparse.set(i, j, true);
+      sparse.set(j, i, true);
+    }
+  }
+
+  bool has(Index i, Index j) const {
+    if (dense) return (rows[i * wordsPerRow + j / 64] >> (j % 64)) & 1;
+    return sparse.get(i, j);
+  }
+
+  // all the locals in the set interfere with each other
+  template<typename LocalSet>
+  void addAll(const LocalSet& locals) {
+    if (!dense) {
+      scratch.clear();
+      locals.forEach([&](Index i) {
+        scratch.push_back(i);
+      });
+      for (Index i = 0; i < scratch.size(); i++) {
+        for (Index j = i + 1; j < scratch.size(); j++) {
+          add(scratch[i], scratch[j]);
+        }
+      }
+      return;
+    }
+    locals.forEach([&](Index i) {
+      mask[i / 64] |= uint64_t(1) << (i % 64);
+    });
+    locals.forEach([&](Index i) {
+      auto* row = &rows[i * wordsPerRow];
+      for (size_t w = 0; w < wordsPerRow; w++) {
+        row[w] |= mask[w];
+      }
+      row[i / 64] &= ~(uint64_t(1) << (i % 64));
+    });
+    locals.forEach([&](Index i) {
+      mask[i / 64] = 0;
+    });
+  }
+
+  // calls func on each local that interferes with i, in no particular order
+  template<typename T>
+  void forEach(Index i, T func) const {
+    if (dense) {
+      auto* row = &rows[i * wordsPerRow];
+      for (size_t w = 0; w < wordsPerRow; w++) {
+        auto word = row[w];
+        while (word) {
+          func(Index(w * 64 + CountTrailingZeroes(word)));
+          word &= word - 1;
+        }
+      }
+    } else {
+      sparse.forEachInRow(i, [&](Index j, bool) {
+        func(j);
+      });
+    }
+  }
+};
+
+// The interferences and copies of the locals merged into each new index
+// while picking indices, with all the old locals. A row is added for each
+// new index as it is used, and each part is stored densely or sparsely by
+// the same limit as the graph it is merged from, as this is created for
+// each order the learner tries.
+struct MergedLocals {
+  Index numLocals;
+  bool denseInterferences, denseCopies;
+  size_t wordsPerRow;
+  Index numRows;
+  std::vector<uint64_t> interferenceRows;
+  std::vector<uint8_t> copyRows;
+  std::vector<std::unordered_set<Index>> sparseInterferences;
+  std::vector<std::unordered_map<Index, uint8_t>> sparseCopies;
+
+  MergedLocals(Index num, bool denseInterferences) : numLocals(num), denseInterferences(denseInterferences), wordsPerRow((num + 63) / 64), numRows(0) {
+    denseCopies = uint64_t(num) * num * 8 <= InterferenceGraph::DenseLimit;
+  }
+
+  void addRow() {
+    numRows++;
+    if (denseInterferences) {
+      interferenceRows.resize(numRows * wordsPerRow);
+    } else {
+      sparseInterferences.emplace_back();
+    }
+    if (denseCopies) {
+      copyRows.resize(size_t(numRows) * numLocals);
+    } else {
+      sparseCopies.emplace_back();
+    }
+  }
+
+  bool interferes(Index row, Index j) const {
+    if (denseInterferences) return (interferenceRows[row * wordsPerRow + j / 64] >> (j % 64)) & 1;
+    return sparseInterferences[row].count(j) > 0;
+  }
+
+  void addInterference(Index row, Index j) {
+    if (denseInterferences) {
+      interferenceRows[row * wordsPerRow + j / 64] |= uint64_t(1) << (j % 64);
+    } else {
+      sparseInterferences[row].insert(j);
+    }
+  }
+
+  uint8_t getCopies(Index row, Index j) const {
+    if (denseCopies) return copyRows[size_t(row) * numLocals + j];
+    auto& copies = sparseCopies[row];
+    auto iter = copies.find(j);
+    return iter == copies.end() ? 0 : iter->second;
+  }
+
+  void addCopies(Index row, Index j, uint8_t count) {
+    if (denseCopies) {
+      copyRows[size_t(row) * numLocals + j] += count;
+    } else {
+      sparseCopies[row][j] += count;
+    }
+  }
+};
+
+template<typename LocalSet> struct LivenessFlow;
+
 struct CoalesceLocals : public WalkerPass<CFGWalker<CoalesceLocals, Visitor<CoalesceLocals>, Liveness>> {
   bool isFunctionParallel() override { return true; }
 
@@ -206,18 +444,10 @@ struct CoalesceLocals : public WalkerPass<CFGWalker<CoalesceLocals, Visitor<Coal
 
   void increaseBackEdgePriorities();
 
-  void flowLiveness();
-
+  // flow liveness across blocks, and use it to find interferences
+  template<typename LocalSet>
   void calculateInterferences();
 
-  void calculateInterferences(const LocalSet& locals);
-
-  // merge starts of a list of blocks, adding new interferences as necessary. return
-  // whether anything changed vs an old state (which indicates further processing is necessary).
-  bool mergeStartsAndCheckChange(std::vector<BasicBlock*>& blocks, LocalSet& old, LocalSet& ret);
-
-  void scanLivenessThroughActions(std::vector<Action>& actions, LocalSet& live);
-
   void pickIndicesFromOrder(std::vector<Index>& order, std::vector<Index>& indices);
   void pickIndicesFromOrder(std::vector<Index>& order, std::vector<Index>& indices, Index& removedCopies);
 
@@ -227,48 +457,93 @@ struct CoalesceLocals : public WalkerPass<CFGWalker<CoalesceLocals, Visitor<Coal
 
   // interference state
 
-  std::vector<bool> interferences; // canonicalized - accesses should check (low, high)
+  InterferenceGraph interferences;
   std::unordered_set<BasicBlock*> liveBlocks;
 
   void interfere(Index i, Index j) {
-    if (i == j) return;
-    interferences[std::min(i, j) * numLocals + std::max(i, j)] = 1;
-  }
-
-  void interfereLowHigh(Index low, Index high) { // optimized version where you know that low < high
-    assert(low < high);
-    interferences[low * numLocals + high] = 1;
+    interferences.add(i, j);
   }
 
   bool interferes(Index i, Index j) {
-    return interferences[std::min(i, j) * numLocals + std::max(i, j)];
+    return interferences.has(i, j);
   }
 
   // copying state
 
-  std::vector<uint8_t> copies; // canonicalized - accesses should check (low, high) TODO: use a map for high N, as this tends to be sparse? or don't look at copies at all for big N?
+  SparseSquareMatrix<uint8_t> copies; // symmetric
   std::vector<Index> totalCopies; // total # of copies for each local, with all others
 
   void addCopy(Index i, Index j) {
-    auto k = std::min(i, j) * numLocals + std::max(i, j);
-    copies[k] = std::min(copies[k], uint8_t(254)) + 1;
+    auto count = std::min(copies.get(i, j), uint8_t(254)) + 1;
+    copies.set(i, j, count);
+    copies.set(j, i, count);
     totalCopies[i]++;
     totalCopies[j]++;
   }
 
   uint8_t getCopies(Index i, Index j) {
-    return copies[std::min(i, j) * numLocals + std::max(i, j)];
+    return copies.get(i, j);
+  }
+};
+
+// Liveness analysis using a particular representation of sets of locals.
+template<typename LocalSet>
+struct LivenessFlow {
+  typedef CoalesceLocals::BasicBlock BasicBlock;
+
+  CoalesceLocals* parent;
+  std::vector<LocalSet> starts, ends; // live locals at the start and end of each block
+
+  LivenessFlow(CoalesceLocals* parent) : parent(parent) {
+    starts.resize(parent->basicBlocks.size(), LocalSet(parent->numLocals));
+    ends.resize(parent->basicBlocks.size(), LocalSet(parent->numLocals));
   }
+
+  void flowLiveness();
+
+  // merge starts of a list of blocks. return whether anything changed vs an old
+  // state (which indicates further processing is necessary).
+  bool mergeStartsAndCheckChange(std::vector<BasicBlock*>& blocks, LocalSet& old, LocalSet& ret);
+
+  void scanLivenessThroughActions(std::vector<Action>& actions, LocalSet& live);
+
+  void calculateInterferences();
 };
 
+template<typename LocalSet>
+void CoalesceLocals::calculateInterferences() {
+  LivenessFlow<LocalSet> flow(this);
+#ifdef CFG_PROFILE
+  static Timer timer("flow");
+  timer.start();
+#endif
+  flow.flowLiveness();
+#ifdef CFG_PROFILE
+  timer.stop();
+  timer.dump();
+#endif
+  flow.calculateInterferences();
+#ifdef CFG_DEBUG
+  for (Index i = 0; i < numLocals; i++) {
+    std::cout << "int for " << getFunction()->getLocalName(i) << " [" << i << "]: ";
+    for (Index j = 0; j < numLocals; j++) {
+      if (interferes(i, j)) std::cout << getFunction()->getLocalName(j) << " ";
+    }
+    std::cout << "\n";
+  }
+#endif
+}
+
 void CoalesceLocals::doWalkFunction(Function* func) {
   numLocals = func->getNumLocals();
-  copies.resize(numLocals * numLocals);
-  std::fill(copies.begin(), copies.end(), 0);
+  copies.recreate(numLocals);
   totalCopies.resize(numLocals);
   std::fill(totalCopies.begin(), totalCopies.end(), 0);
   // collect initial liveness info
   WalkerPass<CFGWalker<CoalesceLocals, Visitor<CoalesceLocals>, Liveness>>::doWalkFunction(func);
+  for (Index i = 0; i < basicBlocks.size(); i++) {
+    basicBlocks[i]->contents.index = i;
+  }
   // ignore links to dead blocks, so they don't confuse us and we can see their stores are all ineffective
   liveBlocks = findLiveBlocks();
   unlinkDeadBlocks(liveBlocks);
@@ -276,19 +551,14 @@ void CoalesceLocals::doWalkFunction(Function* func) {
   increaseBackEdgePriorities();
 #ifdef CFG_DEBUG
   dumpCFG("the cfg");
-#endif
-  // flow liveness across blocks
-#ifdef CFG_PROFILE
-  static Timer timer("flow");
-  timer.start();
-#endif
-  flowLiveness();
-#ifdef CFG_PROFILE
-  timer.stop();
-  timer.dump();
 #endif
   // use liveness to find interference
-  calculateInterferences();
+  interferences.recreate(numLocals);
+  if (numLocals <= DenseLivenessLimit) {
+    calculateInterferences<DenseLocalSet>();
+  } else {
+    calculateInterferences<SortedLocalSet>();
+  }
   // pick new indices
   std::vector<Index> indices;
   pickIndices(indices);
@@ -318,70 +588,60 @@ void CoalesceLocals::increaseBackEdgePriorities() {
   }
 }
 
-void CoalesceLocals::flowLiveness() {
-  interferences.resize(numLocals * numLocals);
-  std::fill(interferences.begin(), interferences.end(), 0);
+template<typename LocalSet>
+void LivenessFlow<LocalSet>::flowLiveness() {
   // keep working while stuff is flowing
   std::unordered_set<BasicBlock*> queue;
-  for (auto& curr : basicBlocks) {
-    if (liveBlocks.count(curr.get()) == 0) continue; // ignore dead blocks
+  for (auto& curr : parent->basicBlocks) {
+    if (parent->liveBlocks.count(curr.get()) == 0) continue; // ignore dead blocks
     queue.insert(curr.get());
     // do the first scan through the block, starting with nothing live at the end, and updating the liveness at the start
-    scanLivenessThroughActions(curr->contents.actions, curr->contents.start);
+    scanLivenessThroughActions(curr->contents.actions, starts[curr->contents.index]);
   }
   // at every point in time, we assume we already noted interferences between things already known alive at the end, and scanned back through the block using that
   while (queue.size() > 0) {
     auto iter = queue.begin();
     auto* curr = *iter;
     queue.erase(iter);
-    LocalSet live;
-    if (!mergeStartsAndCheckChange(curr->out, curr->contents.end, live)) continue;
+    auto& start = starts[curr->contents.index];
+    auto& end = ends[curr->contents.index];
+    LocalSet live(parent->numLocals);
+    if (!mergeStartsAndCheckChange(curr->out, end, live)) continue;
 #ifdef CFG_DEBUG
-    std::cout << "change noticed at end of " << debugIds[curr] << " from " << curr->contents.end.size() << " to " << live.size() << " (out of " << numLocals << ")\n";
+    std::cout << "change noticed at end of " << parent->debugIds[curr] << " from " << end.size() << " to " << live.size() << " (out of " << parent->numLocals << ")\n";
 #endif
-    assert(curr->contents.end.size() < live.size());
-    curr->contents.end = live;
+    assert(end.size() < live.size());
+    end = live;
     scanLivenessThroughActions(curr->contents.actions, live);
     // liveness is now calculated at the start. if something
     // changed, all predecessor blocks need recomputation
-    if (curr->contents.start == live) continue;
+    if (start == live) continue;
 #ifdef CFG_DEBUG
-    std::cout << "change noticed at start of " << debugIds[curr] << " from " << curr->contents.start.size() << " to " << live.size() << ", more work to do\n";
+    std::cout << "change noticed at start of " << parent->debugIds[curr] << " from " << start.size() << " to " << live.size() << ", more work to do\n";
 #endif
-    assert(curr->contents.start.size() < live.size());
-    curr->contents.start = live;
+    assert(start.size() < live.size());
+    start = live;
     for (auto* in : curr->in) {
       queue.insert(in);
     }
   }
-#ifdef CFG_DEBUG
-  std::hash<std::vector<bool>> hasher;
-  std::cout << getFunction()->name << ": interference hash: " << hasher(*(std::vector<bool>*)&interferences) << "\n";
-  for (Index i = 0; i < numLocals; i++) {
-    std::cout << "int for " << getFunction()->getLocalName(i) << " [" << i << "]: ";
-    for (Index j = 0; j < numLocals; j++) {
-      if (interferes(i, j)) std::cout << getFunction()->getLocalName(j) << " ";
-    }
-    std::cout << "\n";
-  }
-#endif
 }
 
-// merge starts of a list of blocks. return
-// whether anything changed vs an old state (which indicates further processing is necessary).
-bool CoalesceLocals::mergeStartsAndCheckChange(std::vector<BasicBlock*>& blocks, LocalSet& old, LocalSet& ret) {
+template<typename LocalSet>
+bool LivenessFlow<LocalSet>::mergeStartsAndCheckChange(std::vector<BasicBlock*>& blocks, LocalSet& old, LocalSet& ret) {
   if (blocks.size() == 0) return false;
-  ret = blocks[0]->contents.start;
+  ret = starts[blocks[0]->contents.index];
   if (blocks.size() > 1) {
     // more than one, so we must merge
     for (Index i = 1; i < blocks.size(); i++) {
-      ret = ret.merge(blocks[i]->contents.start);
+      ret.merge(starts[blocks[i]->contents.index]);
     }
   }
   return old != ret;
 }
 
-void CoalesceLocals::scanLivenessThroughActions(std::vector<Action>& actions, LocalSet& live) {
+template<typename LocalSet>
+void LivenessFlow<LocalSet>::scanLivenessThroughActions(std::vector<Action>& actions, LocalSet& live) {
   // move towards the front
   for (int i = int(actions.size()) - 1; i >= 0; i--) {
     auto& action = actions[i];
@@ -393,12 +653,13 @@ void CoalesceLocals::scanLivenessThroughActions(std::vector<Action>& actions, Lo
   }
 }
 
-void CoalesceLocals::calculateInterferences() {
-  for (auto& curr : basicBlocks) {
-    if (liveBlocks.count(curr.get()) == 0) continue; // ignore dead blocks
+template<typename LocalSet>
+void LivenessFlow<LocalSet>::calculateInterferences() {
+  for (auto& curr : parent->basicBlocks) {
+    if (parent->liveBlocks.count(curr.get()) == 0) continue; // ignore dead blocks
     // everything coming in might interfere, as it might come from a different block
-    auto live = curr->contents.end;
-    calculateInterferences(live);
+    auto live = ends[curr->contents.index];
+    parent->interferences.addAll(live);
     // scan through the block itself
     auto& actions = curr->contents.actions;
     for (int i = int(actions.size()) - 1; i >= 0; i--) {
@@ -407,9 +668,9 @@ void CoalesceLocals::calculateInterferences() {
       if (action.isGet()) {
         // new live local, interferes with all the rest
         live.insert(index);
-        for (auto i : live) {
-          interfere(i, index);
-        }
+        live.forEach([&](Index i) {
+          parent->interfere(i, index);
+        });
       } else {
         if (live.erase(index)) {
           action.effective = true;
@@ -419,21 +680,12 @@ void CoalesceLocals::calculateInterferences() {
   }
   // Params have a value on entry, so mark them as live, as variables
   // live at the entry expect their zero-init value.
-  LocalSet start = entry->contents.start;
-  auto numParams = getFunction()->getNumParams();
+  LocalSet start = starts[parent->entry->contents.index];
+  auto numParams = parent->getFunction()->getNumParams();
   for (Index i = 0; i < numParams; i++) {
     start.insert(i);
   }
-  calculateInterferences(start);
-}
-
-void CoalesceLocals::calculateInterferences(const LocalSet& locals) {
-  Index size = locals.size();
-  for (Index i = 0; i < size; i++) {
-    for (Index j = i + 1; j < size; j++) {
-      interfereLowHigh(locals[i], locals[j]);
-    }
-  }
+  parent->interferences.addAll(start);
 }
 
 // Indices decision making
@@ -478,15 +730,10 @@ void CoalesceLocals::pickIndicesFromOrder(std::vector<Index>& order, std::vector
 #endif
   // TODO: take into account distribution (99-1 is better than 50-50 with two registers, for gzip)
   std::vector<WasmType> types;
-  std::vector<bool> newInterferences; // new index * numLocals => list of all interferences of locals merged to it
-  std::vector<uint8_t> newCopies; // new index * numLocals => list of all copies of locals merged to it
+  MergedLocals merged(numLocals, interferences.dense); // new index, old index => interferences and copies of the locals merged to the new index with the old
   indices.resize(numLocals);
   types.resize(numLocals);
-  newInterferences.resize(numLocals * numLocals);
-  std::fill(newInterferences.begin(), newInterferences.end(), 0);
   auto numParams = getFunction()->getNumParams();
-  newCopies.resize(numParams * numLocals); // start with enough room for the params
-  std::fill(newCopies.begin(), newCopies.end(), 0);
   Index nextFree = 0;
   removedCopies = 0;
   // we can't reorder parameters, they are fixed in order, and cannot coalesce
@@ -495,10 +742,13 @@ void CoalesceLocals::pickIndicesFromOrder(std::vector<Index>& order, std::vector
     assert(order[i] == i); // order must leave the params in place
     indices[i] = i;
     types[i] = getFunction()->getLocalType(i);
-    for (Index j = numParams; j < numLocals; j++) {
-      newInterferences[numLocals * i + j] = interferes(i, j);
-      newCopies[numLocals * i + j] = getCopies(i, j);
-    }
+    merged.addRow();
+    interferences.forEach(i, [&](Index j) {
+      if (j >= numParams) merged.addInterference(i, j);
+    });
+    copies.forEachInRow(i, [&](Index j, uint8_t count) {
+      if (j >= numParams) merged.addCopies(i, j, count);
+    });
     nextFree++;
   }
   for (; i < numLocals; i++) {
@@ -506,10 +756,10 @@ void CoalesceLocals::pickIndicesFromOrder(std::vector<Index>& order, std::vector
     Index found = -1;
     uint8_t foundCopies = -1;
     for (Index j = 0; j < nextFree; j++) {
-      if (!newInterferences[j * numLocals + actual] && getFunction()->getLocalType(actual) == types[j]) {
+      if (!merged.interferes(j, actual) && getFunction()->getLocalType(actual) == types[j]) {
         // this does not interfere, so it might be what we want. but pick the one eliminating the most copies
         // (we could stop looking forward when there are no more items that have copies anyhow, but it doesn't seem to help)
-        auto currCopies = newCopies[j * numLocals + actual];
+        auto currCopies = merged.getCopies(j, actual);
         if (found == Index(-1) || currCopies > foundCopies) {
           indices[actual] = found = j;
           foundCopies = currCopies;
@@ -519,21 +769,23 @@ void CoalesceLocals::pickIndicesFromOrder(std::vector<Index>& order, std::vector
     if (found == Index(-1)) {
       indices[actual] = found = nextFree;
       types[found] = getFunction()->getLocalType(actual);
+      merged.addRow();
       nextFree++;
       removedCopies += getCopies(found, actual);
-      newCopies.resize(nextFree * numLocals);
     } else {
       removedCopies += foundCopies;
     }
 #if CFG_DEBUG
     std::cerr << "set local $" << actual << " to $" << found << '\n';
 #endif
-    // merge new interferences and copies for the new index
-    for (Index k = i + 1; k < numLocals; k++) {
-      auto j = order[k]; // go in the order, we only need to update for those we will see later
-      newInterferences[found * numLocals + j] = newInterferences[found * numLocals + j] | interferes(actual, j);
-      newCopies[found * numLocals + j] += getCopies(actual, j);
-    }
+    // merge new interferences and copies for the new index. we only need those
+    // with locals we will see later, but it is cheaper to just add all of them
+    interferences.forEach(actual, [&](Index j) {
+      merged.addInterference(found, j);
+    });
+    copies.forEachInRow(actual, [&](Index j, uint8_t count) {
+      merged.addCopies(found, j, count);
+    });
   }
 }
 
@@ -732,6 +984,7 @@ void CoalesceLocalsWithLearning::pickIndices(std::vector<Index>& indices) {
   struct Generator {
     Generator(CoalesceLocalsWithLearning* parent) : parent(parent), noise(42) {}
 
+    // this is called on several orders in parallel, so it must only read the parent
     void calculateFitness(Order* order) {
       // apply the order
       std::vector<Index> indices; // the phenotype
@@ -768,10 +1021,6 @@ void CoalesceLocalsWithLearning::pickIndices(std::vector<Index>& indices) {
         // leave params alone, shuffle the rest
         std::shuffle(ret->begin() + parent->getFunction()->getNumParams(), ret->end(), noise);
       }
-      calculateFitness(ret);
-#ifdef CFG_LEARN_DEBUG
-      order->dump("new rando");
-#endif
       return ret;
     }
 
@@ -797,10 +1046,6 @@ void CoalesceLocalsWithLearning::pickIndices(std::vector<Index>& indices) {
           i++; // if we don't skip, we might end up pushing an element all the way to the end, which is not very perturbation-y
         }
       }
-      calculateFitness(ret);
-#ifdef CFG_LEARN_DEBUG
-      ret->dump("new mixture");
-#endif
       return ret;
     }
 
@@ -813,6 +1058,8 @@ void CoalesceLocalsWithLearning::pickIndices(std::vector<Index>& indices) {
 #ifdef CFG_LEARN_DEBUG
   std::cout << "[learning for " << getFunction()->name << "]\n";
 #endif
+  auto budget = std::chrono::milliseconds(getPassOptions().learningTimeBudget);
+  auto deadline = std::chrono::steady_clock::now() + budget;
   auto numVars = this->getFunction()->getNumVars();
   const int GENERATION_SIZE = std::min(Index(numVars * (numVars - 1)), Index(20));
   Generator generator(this);
@@ -820,9 +1067,10 @@ void CoalesceLocalsWithLearning::pickIndices(std::vector<Index>& indices) {
 #ifdef CFG_LEARN_DEBUG
   learner.getBest()->dump("first best");
 #endif
-  // keep working while we see improvement
+  // keep working while we see improvement, and have time
   auto oldBest = learner.getBest()->getFitness();
   while (1) {
+    if (budget.count() > 0 && std::chrono::steady_clock::now() >= deadline) break;
     learner.runGeneration();
     auto newBest = learner.getBest()->getFitness();
     if (newBest == oldBest) break; // unlikely we can improve
@@ -20,106 +20,121 @@
 // identical when finally lowered into concrete wasm code.
 //
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "wasm.h"
 #include "pass.h"
 #include "ast_utils.h"
 #include "support/hash.h"
+#include "support/threads.h"
 
 namespace wasm {
 
 struct FunctionHasher : public WalkerPass<PostWalker<FunctionHasher>> {
   bool isFunctionParallel() override { return true; }
 
-  FunctionHasher(std::map<Function*, uint32_t>* output) : output(output) {}
+  FunctionHasher(std::unordered_map<Function*, uint64_t>* output) : output(output) {}
 
   FunctionHasher* create() override {
     return new FunctionHasher(output);
   }
 
   void doWalkFunction(Function* func) {
+    // we only hash the functions we are asked to
+    if (output->count(func) == 0) return;
     assert(digest == 0);
     hash(func->getNumParams());
     for (auto type : func->params) hash(type);
     hash(func->getNumVars());
     for (auto type : func->vars) hash(type);
     hash(func->result);
-    hash64(func->type.is() ? uint64_t(func->type.str) : uint64_t(0));
+    hash(func->type.is() ? uint64_t(func->type.str) : uint64_t(0));
     hash(ExpressionAnalyzer::hash(func->body));
     output->at(func) = digest;
+    digest = 0;
   }
 
 private:
-  std::map<Function*, uint32_t>* output;
-  uint32_t digest = 0;
+  std::unordered_map<Function*, uint64_t>* output;
+  uint64_t digest = 0;
 
-  void hash(uint32_t hash) {
-    digest = rehash(digest, hash);
+  void hash(uint64_t hash) {
+    digest = rehash64(digest, hash);
   }
-  void hash64(uint64_t hash) {
-    digest = rehash(rehash(digest, hash >> 32), uint32_t(hash));
-  };
 };
 
 struct FunctionReplacer : public WalkerPass<PostWalker<FunctionReplacer>> {
   bool isFunctionParallel() override { return true; }
 
-  FunctionReplacer(std::map<Name, Name>* replacements) : replacements(replacements) {}
+  FunctionReplacer(std::unordered_map<Name, Name>* replacements, std::unordered_map<Function*, bool>* changed) : replacements(replacements), changed(changed) {}
 
   FunctionReplacer* create() override {
-    return new FunctionReplacer(replacements);
+    return new FunctionReplacer(replacements, changed);
   }
 
   void visitCall(Call* curr) {
     auto iter = replacements->find(curr->target);
     if (iter != replacements->end()) {
       curr->target = iter->second;
+      changed->at(getFunction()) = true;
     }
   }
 
 private:
-  std::map<Name, Name>* replacements;
+  std::unordered_map<Name, Name>* replacements;
+  std::unordered_map<Function*, bool>* changed;
 };
 
 struct DuplicateFunctionElimination : public Pass {
   void run(PassRunner* runner, Module* module) override {
+    // Hash all the functions. After the first time, only the functions in
+    // which we replaced calls have changed, and only those are hashed again.
+    // The functions in a hash group are all different from each other after
+    // we look for duplicates in it, so later we only need to look again in
+    // the groups that a rehashed function joined.
+    std::unordered_map<Function*, uint64_t> toHash;
+    hashes.clear();
+    hashGroups.clear();
+    order.clear();
+    for (auto& func : module->functions) {
+      Index index = order.size();
+      order[func.get()] = index;
+      toHash[func.get()] = 0; // ensure an entry for each function - we must not modify the map shape in parallel, just the values
+    }
     while (1) {
-      // Hash all the functions
-      hashes.clear();
-      for (auto& func : module->functions) {
-        hashes[func.get()] = 0; // ensure an entry for each function - we must not modify the map shape in parallel, just the values
-      }
       PassRunner hasherRunner(module);
       hasherRunner.setIsNested(true);
-      hasherRunner.add<FunctionHasher>(&hashes);
+      hasherRunner.add<FunctionHasher>(&toHash);
       hasherRunner.run();
-      // Find hash-equal groups
-      std::map<uint32_t, std::vector<Function*>> hashGroups;
-      for (auto& func : module->functions) {
-        hashGroups[hashes[func.get()]].push_back(func.get());
+      // Move the rehashed functions to their new groups
+      std::unordered_set<uint64_t> joined;
+      for (auto& pair : toHash) {
+        auto* func = pair.first;
+        auto iter = hashes.find(func);
+        if (iter != hashes.end()) {
+          leaveGroup(func, iter->second);
+        }
+        hashes[func] = pair.second;
+        hashGroups[pair.second].push_back(func);
+        joined.insert(pair.second);
       }
-      // Find actually equal functions and prepare to replace them
-      std::map<Name, Name> replacements;
-      std::set<Name> duplicates;
-      for (auto& pair : hashGroups) {
-        auto& group = pair.second;
-        if (group.size() == 1) continue;
-        // pick a base for each group, and try to replace everyone else to it. TODO: multiple bases per hash group, for collisions
-#if 0
-        // for comparison purposes, pick in a deterministic way based on the names
-        Function* base = nullptr;
-        for (auto* func : group) {
-          if (!base || strcmp(func->name.str, base->name.str) < 0) {
-            base = func;
-          }
+      std::vector<std::vector<Function*>*> groups;
+      for (auto hash : joined) {
+        auto& group = hashGroups[hash];
+        if (group.size() > 1) {
+          groups.push_back(&group);
         }
-#else
-        Function* base = group[0];
-#endif
-        for (auto* func : group) {
-          if (func != base && equal(func, base)) {
-            replacements[func->name] = base->name;
-            duplicates.insert(func->name);
-          }
+      }
+      // Find actually equal functions and prepare to replace them. Groups
+      // are independent, so we look in them in parallel.
+      auto results = findDuplicates(groups);
+      std::unordered_map<Name, Name> replacements;
+      std::unordered_set<Function*> duplicates;
+      for (auto& result : results) {
+        for (auto& pair : result) {
+          replacements[pair.first->name] = pair.second->name;
+          duplicates.insert(pair.first);
         }
       }
       // perform replacements
@@ -127,14 +142,27 @@ struct DuplicateFunctionElimination : public Pass {
         // remove the duplicates
         auto& v = module->functions;
         v.erase(std::remove_if(v.begin(), v.end(), [&](const std::unique_ptr<Function>& curr) {
-          return duplicates.count(curr->name) > 0;
+          if (duplicates.count(curr.get()) == 0) return false;
+          hashes.erase(curr.get());
+          order.erase(curr.get());
+          return true;
         }), v.end());
         module->updateMaps();
-        // replace direct calls
+        // replace direct calls, noting which functions that changes
+        std::unordered_map<Function*, bool> changed;
+        for (auto& func : module->functions) {
+          changed[func.get()] = false;
+        }
         PassRunner replacerRunner(module);
         replacerRunner.setIsNested(true);
-        replacerRunner.add<FunctionReplacer>(&replacements);
+        replacerRunner.add<FunctionReplacer>(&replacements, &changed);
         replacerRunner.run();
+        toHash.clear();
+        for (auto& pair : changed) {
+          if (pair.second) {
+            toHash[pair.first] = 0;
+          }
+        }
         // replace in table
         for (auto& segment : module->table.segments) {
           for (auto& name : segment.data) {
@@ -165,7 +193,56 @@ struct DuplicateFunctionElimination : public Pass {
   }
 
 private:
-  std::map<Function*, uint32_t> hashes;
+  std::unordered_map<Function*, uint64_t> hashes;
+  // the functions with each hash, which are all different after we look
+  // for duplicates among them
+  std::unordered_map<uint64_t, std::vector<Function*>> hashGroups;
+  // the original position of each function, so we pick the base of a set
+  // of duplicates deterministically
+  std::unordered_map<Function*, Index> order;
+
+  void leaveGroup(Function* func, uint64_t hash) {
+    auto& group = hashGroups[hash];
+    group.erase(std::find(group.begin(), group.end(), func));
+    if (group.empty()) {
+      hashGroups.erase(hash);
+    }
+  }
+
+  // Compares the functions in each group, leaving one of each set of
+  // duplicates in it. Returns pairs of a duplicate and the function
+  // to replace it with. The groups are split among the pool's threads,
+  // each of which returns its results separately.
+  std::vector<std::vector<std::pair<Function*, Function*>>> findDuplicates(std::vector<std::vector<Function*>*>& groups) {
+    std::vector<std::vector<std::pair<Function*, Function*>>> results(getNumParallelWorkers(groups.size()));
+    parallelFor(groups.size(), [&](size_t worker, size_t index) {
+      findDuplicates(*groups[index], results[worker]);
+    });
+    return results;
+  }
+
+  void findDuplicates(std::vector<Function*>& group, std::vector<std::pair<Function*, Function*>>& result) {
+    std::sort(group.begin(), group.end(), [&](Function* left, Function* right) {
+      return order.at(left) < order.at(right);
+    });
+    // each function is either a duplicate of an earlier one, or the base
+    // of a new set of duplicates, as hashes can collide
+    std::vector<Function*> bases;
+    for (auto* func : group) {
+      bool found = false;
+      for (auto* base : bases) {
+        if (equal(func, base)) {
+          result.emplace_back(func, base);
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        bases.push_back(func);
+      }
+    }
+    group.swap(bases);
+  }
 
   bool equal(Function* left, Function* right) {
     if (left->getNumParams() != right->getNumParams()) return false;
@@ -22,6 +22,9 @@
 // speed benefits.
 //
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include <wasm.h>
 #include <pass.h>
 #include <wasm-builder.h>
@@ -32,7 +35,7 @@ namespace wasm {
 struct FunctionUseCounter : public WalkerPass<PostWalker<FunctionUseCounter>> {
   bool isFunctionParallel() override { return true; }
 
-  FunctionUseCounter(std::map<Name, Index>* output) : output(output) {}
+  FunctionUseCounter(std::unordered_map<Name, Index>* output) : output(output) {}
 
   FunctionUseCounter* create() override {
     return new FunctionUseCounter(output);
@@ -43,7 +46,7 @@ struct FunctionUseCounter : public WalkerPass<PostWalker<FunctionUseCounter>> {
   }
 
 private:
-  std::map<Name, Index>* output;
+  std::unordered_map<Name, Index>* output;
 };
 
 struct Action {
@@ -55,8 +58,8 @@ struct Action {
 };
 
 struct InliningState {
-  std::set<Name> canInline;
-  std::map<Name, std::vector<Action>> actionsForFunction; // function name => actions that can be performed in it
+  std::unordered_set<Name> canInline;
+  std::unordered_map<Name, std::vector<Action>> actionsForFunction; // function name => actions that can be performed in it
 };
 
 struct Planner : public WalkerPass<PostWalker<Planner>> {
@@ -138,7 +141,7 @@ struct Inlining : public Pass {
 
   bool iteration(PassRunner* runner, Module* module) {
     // Count uses
-    std::map<Name, Index> uses;
+    std::unordered_map<Name, Index> uses;
     // fill in uses, as we operate on it in parallel (each function to its own entry)
     for (auto& func : module->functions) {
       uses[func->name] = 0;
@@ -178,7 +181,7 @@ struct Inlining : public Pass {
       runner.run();
     }
     // perform inlinings
-    std::set<Name> inlined;
+    std::unordered_set<Name> inlined;
     std::set<Function*> inlinedInto;
     for (auto& func : module->functions) {
       for (auto& action : state.actionsForFunction[func->name]) {
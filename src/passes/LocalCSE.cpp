@@ -44,10 +44,11 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
   // information for an expression we can reuse
   struct UsableInfo {
     Expression** item;
+    Index frame; // where the item is in frames
     Index index; // if not UNUSED, then the local we are assigned to, use that to reuse us
     EffectAnalyzer effects;
 
-    UsableInfo(Expression** item, PassOptions& passOptions) : item(item), index(UNUSED), effects(passOptions, *item) {}
+    UsableInfo(Expression** item, Index frame, PassOptions& passOptions) : item(item), frame(frame), index(UNUSED), effects(passOptions, *item) {}
   };
 
   // a list of usables in a linear execution trace
@@ -73,7 +74,23 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
     }
   }
 
-  std::vector<Expression*> expressionStack;
+  // hashes of the subtrees of the function we have hashed so far
+  ExpressionAnalyzer::ExpressionHashCache hashCache;
+
+  // every expression we entered, in order, with the frame of its parent, so
+  // we can find the parents of an earlier expression
+  struct Frame {
+    Expression* expr;
+    Index parent;
+  };
+  std::vector<Frame> frames;
+  std::vector<Index> frameStack;
+
+  void doWalkFunction(Function* func) {
+    hashCache.clear();
+    frames.clear();
+    walk(func->body);
+  }
 
   static void visitPre(LocalCSE* self, Expression** currp) {
     // pre operations
@@ -84,7 +101,9 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
       self->checkInvalidations(effects);
     }
 
-    self->expressionStack.push_back(curr);
+    auto parent = self->frameStack.empty() ? UNUSED : self->frameStack.back();
+    self->frameStack.push_back(self->frames.size());
+    self->frames.push_back(Frame{ curr, parent });
   }
 
   static void visitPost(LocalCSE* self, Expression** currp) {
@@ -102,7 +121,7 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
       self->checkInvalidations(effects);
     }
 
-    self->expressionStack.pop_back();
+    self->frameStack.pop_back();
   }
 
   // override scan to add a pre and a post check task to all nodes
@@ -129,7 +148,7 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
   }
 
   void handle(Expression** currp, Expression* curr) {
-    HashedExpression hashed(curr);
+    HashedExpression hashed(curr, ExpressionAnalyzer::hash(curr, &hashCache));
     auto iter = usables.find(hashed);
     if (iter != usables.end()) {
       // already exists in the table, this is good to reuse
@@ -138,13 +157,17 @@ struct LocalCSE : public WalkerPass<LinearExecutionWalker<LocalCSE>> {
         // we need to assign to a local. create a new one
         auto index = info.index = Builder::addVar(getFunction(), curr->type);
         (*info.item) = Builder(*getModule()).makeTeeLocal(index, *info.item);
+        // the parents of the item now contain the tee, so their hashes changed
+        for (auto i = frames[info.frame].parent; i != UNUSED; i = frames[i].parent) {
+          hashCache.erase(frames[i].expr);
+        }
       }
       replaceCurrent(
         Builder(*getModule()).makeGetLocal(info.index, curr->type)
       );
     } else {
       // not in table, add this, maybe we can help others later
-      usables.emplace(std::make_pair(hashed, UsableInfo(currp, getPassOptions())));
+      usables.emplace(std::make_pair(hashed, UsableInfo(currp, frameStack.back(), getPassOptions())));
     }
   }
 };
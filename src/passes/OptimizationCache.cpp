@@ -0,0 +1,165 @@
+/*
+ * Copyright 2017 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "optimization-cache.h"
+#include "asm_v_wasm.h"
+#include "wasm-printing.h"
+#include "wasm-s-parser.h"
+
+namespace wasm {
+
+// bump this when the optimizer changes in ways that make old entries wrong
+static const char* CacheVersion = "1";
+
+// The things a function refers to in the module. Passes may look at their
+// types, so those are part of the key.
+struct ReferenceCollector : public PostWalker<ReferenceCollector> {
+  std::set<Name> functions, imports, globals, types;
+
+  void visitCall(Call* curr) { functions.insert(curr->target); }
+  void visitCallImport(CallImport* curr) { imports.insert(curr->target); }
+  void visitCallIndirect(CallIndirect* curr) { types.insert(curr->fullType); }
+  void visitGetGlobal(GetGlobal* curr) { globals.insert(curr->name); }
+  void visitSetGlobal(SetGlobal* curr) { globals.insert(curr->name); }
+};
+
+OptimizationCache::OptimizationCache(std::string directory) : directory(directory), tempCounter(0), hits(0), misses(0) {
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0777);
+#endif
+  nonce = (uint64_t(std::random_device()()) << 32) | std::random_device()();
+}
+
+std::string OptimizationCache::getKey(const std::vector<Pass*>& passes, const PassOptions& options, Module* module, Function* func) {
+  if (!func->debugLocations.empty()) return "";
+  std::ostringstream key;
+  key << "binaryen optimization cache " << CacheVersion << '\n';
+  key << "passes:";
+  for (auto* pass : passes) {
+    key << ' ' << pass->name;
+  }
+  key << '\n';
+  key << "options: " << options.debug << ' ' << options.validateGlobally << ' ' << options.optimizeLevel << ' '
+      << options.shrinkLevel << ' ' << options.ignoreImplicitTraps << ' ' << options.learningTimeBudget << '\n';
+  ReferenceCollector references;
+  references.walk(func->body);
+  for (auto name : references.functions) {
+    auto* target = module->getFunctionOrNull(name);
+    key << "function " << name << ' ' << (target ? getSig(target) : "?") << '\n';
+  }
+  for (auto name : references.imports) {
+    auto* import = module->getImportOrNull(name);
+    auto* type = import ? module->getFunctionTypeOrNull(import->functionType) : nullptr;
+    key << "import " << name << ' ' << (type ? getSig(type) : "?") << '\n';
+  }
+  for (auto name : references.globals) {
+    auto* global = module->getGlobalOrNull(name);
+    if (global) {
+      key << "global " << name << ' ' << printWasmType(global->type) << (global->mutable_ ? " mut" : "") << '\n';
+    } else {
+      auto* import = module->getImportOrNull(name);
+      key << "global import " << name << ' ' << (import ? printWasmType(import->globalType) : "?") << '\n';
+    }
+  }
+  for (auto name : references.types) {
+    auto* type = module->getFunctionTypeOrNull(name);
+    key << "type " << name << ' ' << (type ? getSig(type) : "?") << '\n';
+  }
+  WasmPrinter::printFunction(func, module, key);
+  key << '\n';
+  return key.str();
+}
+
+std::string OptimizationCache::getPath(const std::string& key) {
+  // 64-bit FNV-1a, which unlike our other hashes does not depend on pointers
+  uint64_t hash = 14695981039346656037ULL;
+  for (auto c : key) {
+    hash = (hash ^ uint8_t(c)) * 1099511628211ULL;
+  }
+  char name[20];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+  return directory + "/" + name;
+}
+
+bool OptimizationCache::load(const std::string& key, Module* module, Function* func) {
+  std::ifstream file(getPath(key), std::ios::binary);
+  if (!file.is_open()) {
+    misses++;
+    return false;
+  }
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (contents.size() <= key.size() || contents.compare(0, key.size(), key) != 0) {
+    misses++;
+    return false;
+  }
+  std::string text = contents.substr(key.size());
+  Function* cached = nullptr;
+  try {
+    SExpressionParser parser(&text[0]);
+    Element& root = *parser.root;
+    if (root.size() != 1) throw ParseException("expected one function");
+    SExpressionWasmBuilder builder(*module, *root[0], cached);
+  } catch (ParseException&) {
+    misses++;
+    return false;
+  }
+  assert(cached->params == func->params && cached->result == func->result);
+  func->vars.swap(cached->vars);
+  func->localNames.swap(cached->localNames);
+  func->localIndices.swap(cached->localIndices);
+  func->body = cached->body;
+  delete cached;
+  hits++;
+  return true;
+}
+
+void OptimizationCache::store(const std::string& key, Module* module, Function* func) {
+  auto path = getPath(key);
+  // write to a temporary file first, so others never see a partial entry
+  auto temp = path + ".tmp." + std::to_string(nonce) + "." + std::to_string(tempCounter++);
+  {
+    std::ofstream file(temp, std::ios::binary);
+    if (!file.is_open()) return;
+    file << key;
+    WasmPrinter::printFunction(func, module, file);
+    file << '\n';
+    if (!file.good()) {
+      file.close();
+      std::remove(temp.c_str());
+      return;
+    }
+  }
+  if (std::rename(temp.c_str(), path.c_str()) != 0) {
+    std::remove(temp.c_str());
+  }
+}
+
+} // namespace wasm
@@ -18,13 +18,41 @@
 // Print out text in s-expression format
 //
 
+#include <streambuf>
+
 #include <wasm.h>
 #include <wasm-printing.h>
 #include <pass.h>
 #include <pretty_printing.h>
+#include <support/threads.h>
+#include <support/utilities.h>
 
 namespace wasm {
 
+// An output buffer that appends to a string. Unlike a std::stringbuf, the
+// string is not owned by the buffer, so its space can be reused.
+struct StringBuffer : public std::streambuf {
+  void setTarget(std::string* target_) {
+    target = target_;
+  }
+
+protected:
+  int overflow(int c) override {
+    if (c != EOF) {
+      target->push_back(char(c));
+    }
+    return c;
+  }
+
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    target->append(s, n);
+    return n;
+  }
+
+private:
+  std::string* target = nullptr;
+};
+
 struct PrintSExpression : public Visitor<PrintSExpression> {
   std::ostream& o;
   unsigned indent = 0;
@@ -89,15 +117,15 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     o << maybeNewLine;
   }
 
-  Name printableLocal(Index index) {
-    Name name;
+  // prints the local's name, or if it has none, its index
+  std::ostream& printLocal(Index index) {
     if (currFunction) {
-      name = currFunction->getLocalNameOrDefault(index);
-    }
-    if (!name.is()) {
-      name = Name::fromInt(index);
+      Name name = currFunction->getLocalNameOrDefault(index);
+      if (name.is()) {
+        return o << name;
+      }
     }
-    return name;
+    return printUnsigned(o << '$', index);
   }
 
   std::ostream& printName(Name name) {
@@ -261,7 +289,8 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     decIndent();
   }
   void visitGetLocal(GetLocal *curr) {
-    printOpening(o, "get_local ") << printableLocal(curr->index) << ')';
+    printOpening(o, "get_local ");
+    printLocal(curr->index) << ')';
   }
   void visitSetLocal(SetLocal *curr) {
     if (curr->isTee()) {
@@ -269,7 +298,7 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     } else {
       printOpening(o, "set_local ");
     }
-    o << printableLocal(curr->index);
+    printLocal(curr->index);
     incIndent();
     printFullLine(curr->value);
     decIndent();
@@ -302,10 +331,10 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     }
     restoreNormalColor(o);
     if (curr->offset) {
-      o << " offset=" << curr->offset;
+      printUnsigned(o << " offset=", curr->offset);
     }
     if (curr->align != curr->bytes) {
-      o << " align=" << curr->align;
+      printUnsigned(o << " align=", curr->align);
     }
     incIndent();
     printFullLine(curr->ptr);
@@ -327,10 +356,10 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     }
     restoreNormalColor(o);
     if (curr->offset) {
-      o << " offset=" << curr->offset;
+      printUnsigned(o << " offset=", curr->offset);
     }
     if (curr->align != curr->bytes) {
-      o << " align=" << curr->align;
+      printUnsigned(o << " align=", curr->align);
     }
     incIndent();
     printFullLine(curr->ptr);
@@ -602,7 +631,8 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     if (curr->params.size() > 0) {
       for (size_t i = 0; i < curr->params.size(); i++) {
         o << maybeSpace;
-        printMinorOpening(o, "param ") << printableLocal(i) << ' ' << printWasmType(curr->getLocalType(i)) << ')';
+        printMinorOpening(o, "param ");
+        printLocal(i) << ' ' << printWasmType(curr->getLocalType(i)) << ')';
       }
     }
     if (curr->result != none) {
@@ -612,7 +642,8 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
     incIndent();
     for (size_t i = curr->getVarIndexBase(); i < curr->getNumLocals(); i++) {
       doIndent(o, indent);
-      printMinorOpening(o, "local ") << printableLocal(i) << ' ' << printWasmType(curr->getLocalType(i)) << ')';
+      printMinorOpening(o, "local ");
+      printLocal(i) << ' ' << printWasmType(curr->getLocalType(i)) << ')';
       o << maybeNewLine;
     }
     // It is ok to emit a block here, as a function can directly contain a list, even if our
@@ -697,6 +728,58 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
       o << "\")\n";
     }
   }
+  // Prints the functions of the module. With several threads, they are
+  // printed in batches: the functions in a batch are printed in parallel,
+  // each into its own buffer, and then the buffers are written out in order.
+  void printFunctions(Module* module) {
+    auto& functions = module->functions;
+    size_t num = getNumParallelWorkers(functions.size());
+    if (num == 1) {
+      for (auto& func : functions) {
+        printFunction(func.get());
+      }
+      return;
+    }
+    struct Worker {
+      StringBuffer buffer;
+      std::ostream stream;
+      PrintSExpression print;
+      Worker() : stream(&buffer), print(stream) {}
+    };
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < num; i++) {
+      workers.push_back(make_unique<Worker>());
+      auto& print = workers.back()->print;
+      print.setMinify(minify);
+      print.setFull(full);
+      print.currModule = currModule;
+      print.indent = indent;
+    }
+    // the buffers are reused between batches, so they grow to the size
+    // of the largest functions just once
+    std::vector<std::string> buffers(num * FunctionsPerThreadInBatch);
+    for (size_t start = 0; start < functions.size(); start += buffers.size()) {
+      size_t end = std::min(start + buffers.size(), functions.size());
+      parallelFor(end - start, [&](size_t worker, size_t index) {
+        auto& text = buffers[index];
+        text.clear();
+        workers[worker]->buffer.setTarget(&text);
+        workers[worker]->print.printFunction(functions[start + index].get());
+      });
+      for (size_t i = start; i < end; i++) {
+        auto& text = buffers[i - start];
+        o.write(text.data(), text.size());
+      }
+    }
+  }
+  static const size_t FunctionsPerThreadInBatch = 64;
+
+  void printFunction(Function* func) {
+    doIndent(o, indent);
+    visitFunction(func);
+    o << maybeNewLine;
+  }
+
   void visitModule(Module *curr) {
     currModule = curr;
     printOpening(o, "module", true);
@@ -732,11 +815,7 @@ struct PrintSExpression : public Visitor<PrintSExpression> {
       printOpening(o, "start") << ' ' << curr->start << ')';
       o << maybeNewLine;
     }
-    for (auto& child : curr->functions) {
-      doIndent(o, indent);
-      visitFunction(child.get());
-      o << maybeNewLine;
-    }
+    printFunctions(curr);
     for (auto& section : curr->userSections) {
       doIndent(o, indent);
       o << ";; custom section \"" << section.name << "\", size " << section.data.size();
@@ -810,4 +889,12 @@ std::ostream& WasmPrinter::printExpression(Expression* expression, std::ostream&
   return o;
 }
 
+std::ostream& WasmPrinter::printFunction(Function* func, Module* module, std::ostream& o) {
+  PrintSExpression print(o);
+  print.setFull(false);
+  print.currModule = module;
+  print.visitFunction(func);
+  return o;
+}
+
 } // namespace wasm
@@ -15,11 +15,15 @@
  */
 
 #include <chrono>
+#include <cstdio>
 #include <sstream>
 
 #include <passes/passes.h>
 #include <pass.h>
+#include <ast_utils.h>
 #include <wasm-validator.h>
+#include <optimization-cache.h>
+#include <support/timing.h>
 
 namespace wasm {
 
@@ -161,6 +165,8 @@ void PassRunner::run() {
     for (auto pass : passes) {
       padding = std::max(padding, pass->name.size());
     }
+    // after each pass, validate only the functions it changed
+    IncrementalValidator validator(false, options.validateGlobally);
     for (auto* pass : passes) {
       // ignoring the time, save a printout of the module before, in case this pass breaks it, so we can print the before and after
       std::stringstream moduleBefore;
@@ -172,22 +178,34 @@ void PassRunner::run() {
       for (size_t i = 0; i < padding - pass->name.size(); i++) {
         std::cerr << ' ';
       }
+      auto allocatedBefore = getAllocatedBytesPerThread();
       auto before = std::chrono::steady_clock::now();
       if (pass->isFunctionParallel()) {
         // function-parallel passes should get a new instance per function
-        for (auto& func : wasm->functions) {
-          runPassOnFunction(pass, func.get());
+        size_t profileIndex = profile ? addProfileEntry(pass) : 0;
+        for (size_t i = 0; i < wasm->functions.size(); i++) {
+          runPassOnFunction(pass, wasm->functions[i].get(), profile ? &profile->passes[profileIndex].functions[i] : nullptr);
         }
+        if (profile) profile->passes[profileIndex].sumFunctions();
       } else {
-        pass->run(this, wasm);
+        runPassOnModule(pass);
       }
       auto after = std::chrono::steady_clock::now();
       std::chrono::duration<double> diff = after - before;
       std::cerr << diff.count() << " seconds." << std::endl;
       totalTime += diff;
+      // report arena usage, per thread that allocated
+      auto allocatedAfter = getAllocatedBytesPerThread();
+      for (size_t i = 0; i < allocatedAfter.size(); i++) {
+        size_t allocated = allocatedAfter[i] - (i < allocatedBefore.size() ? allocatedBefore[i] : 0);
+        if (allocated > 0) {
+          std::cerr << "[PassRunner]   (allocated " << allocated << " bytes on " << (i == 0 ? "the main thread" : "side thread " + std::to_string(i)) << ")\n";
+        }
+      }
       // validate, ignoring the time
-      std::cerr << "[PassRunner]   (validating)\n";
-      if (!WasmValidator().validate(*wasm, false, options.validateGlobally)) {
+      bool valid = validator.validate(*wasm);
+      std::cerr << "[PassRunner]   (validated " << validator.numValidated << " changed functions)\n";
+      if (!valid) {
         if (passDebug >= 2) {
           std::cerr << "Last pass (" << pass->name << ") broke validation. Here is the module before: \n" << moduleBefore.str() << "\n";
         } else {
@@ -207,33 +225,76 @@ void PassRunner::run() {
     // non-debug normal mode, run them in an optimal manner - for locality it is better
     // to run as many passes as possible on a single function before moving to the next
     std::vector<Pass*> stack;
+    // estimated cost of running a stack of passes on each function, used to start
+    // the largest functions first. this is computed once, as function sizes do not
+    // change drastically during a run, and it is just a heuristic.
+    std::vector<size_t> costs;
     auto flush = [&]() {
       if (stack.size() > 0) {
         // run the stack of passes on all the functions, in parallel
         size_t num = ThreadPool::get()->size();
-        std::vector<std::function<ThreadWorkState ()>> doWorkers;
-        std::atomic<size_t> nextFunction;
-        nextFunction.store(0);
+        WorkStealingQueue queue(num);
         size_t numFunctions = wasm->functions.size();
+        if (num > 1) {
+          if (costs.size() != numFunctions) {
+            costs.clear();
+            for (auto& func : wasm->functions) {
+              costs.push_back(Measurer::measure(func->body));
+            }
+          }
+          queue.addByCost(costs);
+        } else {
+          for (size_t i = 0; i < numFunctions; i++) {
+            queue.push(i);
+          }
+        }
+        // each (pass, function) pair is run by one thread, which fills in its
+        // own profile entry
+        size_t profileStart = profile ? profile->passes.size() : 0;
+        if (profile) {
+          for (auto* pass : stack) {
+            addProfileEntry(pass);
+          }
+        }
+        std::vector<std::function<ThreadWorkState ()>> doWorkers;
         for (size_t i = 0; i < num; i++) {
-          doWorkers.push_back([&]() {
-            auto index = nextFunction.fetch_add(1);
+          doWorkers.push_back([&, i]() {
+            size_t index;
             // get the next task, if there is one
-            if (index >= numFunctions) {
+            if (!queue.pop(i, index)) {
               return ThreadWorkState::Finished; // nothing left
             }
             Function* func = this->wasm->functions[index].get();
+            // if we optimized this function the same way before, reuse that
+            std::string cacheKey;
+            if (cache) {
+              cacheKey = cache->getKey(stack, options, wasm, func);
+              if (cacheKey.size() > 0 && cache->load(cacheKey, wasm, func)) {
+                return ThreadWorkState::More;
+              }
+            }
             // do the current task: run all passes on this function
-            for (auto* pass : stack) {
-              runPassOnFunction(pass, func);
+            for (size_t j = 0; j < stack.size(); j++) {
+              runPassOnFunction(stack[j], func, profile ? &profile->passes[profileStart + j].functions[index] : nullptr);
             }
-            if (index + 1 == numFunctions) {
-              return ThreadWorkState::Finished; // we did the last one
+            if (cacheKey.size() > 0) {
+              cache->store(cacheKey, wasm, func);
             }
             return ThreadWorkState::More;
           });
         }
+        size_t hitsBefore = cache ? cache->getHits() : 0;
+        size_t missesBefore = cache ? cache->getMisses() : 0;
         ThreadPool::get()->work(doWorkers);
+        if (profile && cache) {
+          profile->cacheHits += cache->getHits() - hitsBefore;
+          profile->cacheMisses += cache->getMisses() - missesBefore;
+        }
+        if (profile) {
+          for (size_t j = 0; j < stack.size(); j++) {
+            profile->passes[profileStart + j].sumFunctions();
+          }
+        }
       }
       stack.clear();
     };
@@ -242,7 +303,7 @@ void PassRunner::run() {
         stack.push_back(pass);
       } else {
         flush();
-        pass->run(this, wasm);
+        runPassOnModule(pass);
       }
     }
     flush();
@@ -269,12 +330,59 @@ void PassRunner::doAdd(Pass* pass) {
   pass->prepareToRun(this, wasm);
 }
 
-void PassRunner::runPassOnFunction(Pass* pass, Function* func) {
+std::vector<size_t> PassRunner::getAllocatedBytesPerThread() {
+  std::vector<size_t> ret;
+  for (auto* arena = &wasm->allocator; arena; arena = arena->next.load()) {
+    ret.push_back(arena->allocatedBytes);
+  }
+  return ret;
+}
+
+static Index measureFunctions(Module* wasm) {
+  Index ret = 0;
+  for (auto& func : wasm->functions) {
+    ret += Measurer::measure(func->body);
+  }
+  return ret;
+}
+
+void PassRunner::runPassOnModule(Pass* pass) {
+  if (!profile) {
+    pass->run(this, wasm);
+    return;
+  }
+  // the pass may use other threads, so measure the process's CPU time and
+  // all the arenas
+  Index nodesBefore = measureFunctions(wasm);
+  size_t bytesBefore = wasm->allocator.getAllocatedBytes();
+  double cpuBefore = getProcessCPUTime();
+  Timer timer;
+  timer.start();
+  pass->run(this, wasm);
+  timer.stop();
+  PassProfile::PassEntry entry;
+  entry.pass = pass->name;
+  entry.total.wallTime = timer.getTotal();
+  entry.total.cpuTime = getProcessCPUTime() - cpuBefore;
+  entry.total.allocatedBytes = wasm->allocator.getAllocatedBytes() - bytesBefore;
+  entry.total.nodeDelta = int64_t(measureFunctions(wasm)) - int64_t(nodesBefore);
+  profile->passes.push_back(std::move(entry));
+}
+
+void PassRunner::runPassOnFunction(Pass* pass, Function* func, PassProfile::Entry* entry) {
 #if 0
   if (debug) {
     std::cerr << "[PassRunner]   runPass " << pass->name << " OnFunction " << func->name << "\n";
   }
 #endif
+  Index nodesBefore = 0;
+  size_t bytesBefore = 0;
+  Timer timer;
+  if (entry) {
+    nodesBefore = Measurer::measure(func->body);
+    bytesBefore = wasm->allocator.getArenaForThisThread().allocatedBytes;
+    timer.start();
+  }
   // function-parallel passes get a new instance per function
   if (pass->isFunctionParallel()) {
     auto instance = std::unique_ptr<Pass>(pass->create());
@@ -282,6 +390,120 @@ void PassRunner::runPassOnFunction(Pass* pass, Function* func) {
   } else {
     pass->runFunction(this, wasm, func);
   }
+  if (entry) {
+    timer.stop();
+    entry->wallTime = timer.getTotal();
+    entry->cpuTime = timer.getCPUTotal();
+    entry->allocatedBytes = wasm->allocator.getArenaForThisThread().allocatedBytes - bytesBefore;
+    entry->nodeDelta = int64_t(Measurer::measure(func->body)) - int64_t(nodesBefore);
+  }
+}
+
+size_t PassRunner::addProfileEntry(Pass* pass) {
+  auto index = profile->passes.size();
+  profile->passes.emplace_back();
+  auto& entry = profile->passes.back();
+  entry.pass = pass->name;
+  if (pass->isFunctionParallel()) {
+    for (auto& func : wasm->functions) {
+      entry.functionNames.push_back(func->name);
+    }
+    entry.functions.resize(wasm->functions.size());
+  }
+  return index;
+}
+
+// PassProfile
+
+void PassProfile::PassEntry::sumFunctions() {
+  total = Entry();
+  for (auto& func : functions) {
+    total.wallTime += func.wallTime;
+    total.cpuTime += func.cpuTime;
+    total.allocatedBytes += func.allocatedBytes;
+    total.nodeDelta += func.nodeDelta;
+  }
+}
+
+static void dumpJSONString(std::ostream& o, const char* str) {
+  o << '"';
+  for (auto* c = str; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      o << '\\' << *c;
+    } else if ((unsigned char)*c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", *c);
+      o << buffer;
+    } else {
+      o << *c;
+    }
+  }
+  o << '"';
+}
+
+static void dumpJSONEntry(std::ostream& o, PassProfile::Entry& entry) {
+  o << "\"wallTime\": " << entry.wallTime
+    << ", \"cpuTime\": " << entry.cpuTime
+    << ", \"allocatedBytes\": " << entry.allocatedBytes
+    << ", \"nodeDelta\": " << entry.nodeDelta;
+}
+
+void PassProfile::dumpJSON(std::ostream& o) {
+  o << "{\n  \"passes\": [";
+  for (size_t i = 0; i < passes.size(); i++) {
+    auto& pass = passes[i];
+    o << (i > 0 ? ",\n" : "\n") << "    { \"pass\": ";
+    dumpJSONString(o, pass.pass.c_str());
+    o << ", ";
+    dumpJSONEntry(o, pass.total);
+    o << ", \"functions\": [";
+    for (size_t j = 0; j < pass.functions.size(); j++) {
+      o << (j > 0 ? ",\n" : "\n") << "      { \"function\": ";
+      dumpJSONString(o, pass.functionNames[j].str);
+      o << ", ";
+      dumpJSONEntry(o, pass.functions[j]);
+      o << " }";
+    }
+    o << (pass.functions.size() > 0 ? "\n    ] }" : "] }");
+  }
+  o << "\n  ]";
+  if (cacheHits + cacheMisses > 0) {
+    o << ",\n  \"cache\": { \"hits\": " << cacheHits << ", \"misses\": " << cacheMisses << " }";
+  }
+  o << "\n}\n";
+}
+
+static void dumpCSVString(std::ostream& o, const char* str) {
+  o << '"';
+  for (auto* c = str; *c; c++) {
+    if (*c == '"') o << '"';
+    o << *c;
+  }
+  o << '"';
+}
+
+static void dumpCSVEntry(std::ostream& o, PassProfile::Entry& entry) {
+  o << entry.wallTime << ',' << entry.cpuTime << ',' << entry.allocatedBytes << ',' << entry.nodeDelta << '\n';
+}
+
+void PassProfile::dumpCSV(std::ostream& o) {
+  // the totals for a pass have an empty function name
+  o << "index,pass,function,wallTime,cpuTime,allocatedBytes,nodeDelta\n";
+  for (size_t i = 0; i < passes.size(); i++) {
+    auto& pass = passes[i];
+    o << i << ',';
+    dumpCSVString(o, pass.pass.c_str());
+    o << ",,";
+    dumpCSVEntry(o, pass.total);
+    for (size_t j = 0; j < pass.functions.size(); j++) {
+      o << i << ',';
+      dumpCSVString(o, pass.pass.c_str());
+      o << ',';
+      dumpCSVString(o, pass.functionNames[j].str);
+      o << ',';
+      dumpCSVEntry(o, pass.functions[j]);
+    }
+  }
 }
 
 } // namespace wasm
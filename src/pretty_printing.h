@@ -21,15 +21,40 @@
 #ifndef wasm_pretty_printing_h
 #define wasm_pretty_printing_h
 
+#include <cstdint>
 #include <ostream>
 
 #include "support/colors.h"
 
 inline std::ostream &doIndent(std::ostream &o, unsigned indent) {
-  for (unsigned i = 0; i < indent; i++) {
-    o << " ";
+  static const char spaces[] = "                                ";
+  const unsigned chunk = sizeof(spaces) - 1;
+  while (indent > chunk) {
+    o.write(spaces, chunk);
+    indent -= chunk;
   }
-  return o;
+  return o.write(spaces, indent);
+}
+
+// Integers are formatted by hand, which is much faster than the stream's
+// locale-aware formatting.
+inline std::ostream &printUnsigned(std::ostream &o, uint64_t value) {
+  char buffer[20];
+  char *end = buffer + sizeof(buffer);
+  char *start = end;
+  do {
+    *--start = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  return o.write(start, end - start);
+}
+
+inline std::ostream &printSigned(std::ostream &o, int64_t value) {
+  if (value < 0) {
+    o.put('-');
+    return printUnsigned(o, -uint64_t(value));
+  }
+  return printUnsigned(o, value);
 }
 
 inline std::ostream &prepareMajorColor(std::ostream &o) {
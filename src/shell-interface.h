@@ -156,7 +156,7 @@ struct ShellExternalInterface : ModuleInstance::ExternalInterface {
         trap("callIndirect: bad argument type");
       }
     }
-    return instance.callFunctionInternal(func->name, arguments);
+    return instance.callFunctionInternal(func, arguments);
   }
 
   Literal load(Load* load, Address addr) override {
@@ -21,6 +21,13 @@
 #include <cstdint>
 #include <limits>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 template <typename T>
 T wasm::read_file(const std::string &filename, Flags::BinaryOption binary, Flags::DebugOption debug) {
   if (debug == Flags::Debug) std::cerr << "Loading '" << filename << "'..." << std::endl;
@@ -49,6 +56,43 @@ T wasm::read_file(const std::string &filename, Flags::BinaryOption binary, Flags
 template std::string wasm::read_file<>(const std::string &, Flags::BinaryOption, Flags::DebugOption);
 template std::vector<char> wasm::read_file<>(const std::string &, Flags::BinaryOption, Flags::DebugOption);
 
+wasm::MappedFile::MappedFile(const std::string &filename, Flags::BinaryOption binary, Flags::DebugOption debug) {
+#ifndef _WIN32
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 &&
+        uint64_t(info.st_size) < std::numeric_limits<size_t>::max()) {
+      size_t fileSize = info.st_size;
+      size_t pageSize = sysconf(_SC_PAGESIZE);
+      // the '\0' after text comes from the zero-filled rest of the last page,
+      // so if the file fills its last page exactly, we must read it instead
+      if (binary == Flags::Binary || fileSize % pageSize != 0) {
+        void* addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+          if (debug == Flags::Debug) std::cerr << "Mapped '" << filename << "'" << std::endl;
+          contents = (char*)addr;
+          contentsSize = fileSize;
+          mapped = true;
+        }
+      }
+    }
+    close(fd);
+  }
+  if (mapped) return;
+#endif
+  fallback = read_file<std::vector<char>>(filename, binary, debug);
+  // read_file adds a '\0' after text, which is not part of the contents
+  contentsSize = fallback.size() - (binary == Flags::Binary ? 0 : 1);
+  contents = fallback.data();
+}
+
+wasm::MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (mapped) munmap(contents, contentsSize);
+#endif
+}
+
 wasm::Output::Output(const std::string &filename, Flags::BinaryOption binary, Flags::DebugOption debug)
     : outfile(), out([this, filename, binary, debug]() {
         std::streambuf *buffer;
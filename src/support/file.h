@@ -45,6 +45,29 @@ T read_file(const std::string &filename, Flags::BinaryOption binary, Flags::Debu
 extern template std::string read_file<>(const std::string &, Flags::BinaryOption, Flags::DebugOption);
 extern template std::vector<char> read_file<>(const std::string &, Flags::BinaryOption, Flags::DebugOption);
 
+// The contents of a file, memory-mapped when possible so that loading a large
+// file does not need a full copy of it in memory. The contents are read-only,
+// and text is followed by a '\0', like read_file's. When the file cannot be
+// mapped this falls back to read_file.
+class MappedFile {
+ public:
+  MappedFile(const std::string &filename, Flags::BinaryOption binary, Flags::DebugOption debug);
+  ~MappedFile();
+
+  const char* data() { return contents; }
+  // the size of the contents, not including the '\0' after text
+  size_t size() { return contentsSize; }
+
+ private:
+  MappedFile() = delete;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  char* contents = nullptr;
+  size_t contentsSize = 0;
+  bool mapped = false;
+  std::vector<char> fallback;
+};
+
 class Output {
  public:
   // An empty filename will open stdout instead.
@@ -34,6 +34,17 @@ inline uint32_t rehash(uint32_t x, uint32_t y) { // see http://www.cse.yorku.ca/
   return hash;
 }
 
+// Combines two 64-bit values. Unlike rehash, all the bits of both matter,
+// including zero bytes, so values of 0 and where one value's bytes end and
+// the other's begin both change the result.
+inline uint64_t rehash64(uint64_t x, uint64_t y) {
+  uint64_t hash = x ^ (y + 0x9e3779b97f4a7c15ULL + (x << 6) + (x >> 2));
+  // the finalizer of splitmix64, so every input bit affects every output bit
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
 } // namespace wasm
 
 #endif // wasm_support_hash_h
@@ -18,7 +18,11 @@
 #define wasm_learning_h
 
 #include <algorithm>
+#include <memory>
 #include <random>
+#include <vector>
+
+#include "support/threads.h"
 
 namespace wasm {
 
@@ -34,9 +38,17 @@ namespace wasm {
 //
 //  * Genome* makeRandom(); - make a random element
 //  * Genome* makeMixture(Genome* one, Genome* two); - make a new element by mixing two
+//  * void calculateFitness(Genome* genome); - calculate the fitness of a new
+//    element, which getFitness() then returns
 //
 // Fitness is the type of the fitness values, e.g. uint32_t. More is better.
 //
+// New elements are made serially, in a fixed order, but the fitness of all
+// the new elements in a generation is calculated in parallel on the thread
+// pool, so calculateFitness() must be safe to call on several elements at
+// once. As all randomness is in making elements, the results do not depend
+// on the number of threads or on timing.
+//
 // Typical usage of this class is to run call runGeneration(), check the best
 // quality using getBest()->getFitness(), and do that repeatedly until the
 // fitness is good enough. Then acquireBest() to get ownership of the best,
@@ -62,12 +74,29 @@ class GeneticLearner {
     return noise() % population.size();
   }
 
+  // calculates the fitness of population[start..end)
+  void calculateFitness(size_t start, size_t end) {
+    if (end - start == 1) {
+      generator.calculateFitness(population[start].get());
+      return;
+    }
+    TaskGroup group;
+    for (size_t i = start; i < end; i++) {
+      auto* genome = population[i].get();
+      group.spawn([this, genome]() {
+        generator.calculateFitness(genome);
+      });
+    }
+    group.wait();
+  }
+
 public:
   GeneticLearner(Generator& generator, size_t size) : generator(generator), noise(1337) {
     population.resize(size);
     for (size_t i = 0; i < size; i++) {
       population[i] = unique_ptr(generator.makeRandom());
     }
+    calculateFitness(0, size);
     sort();
   }
 
@@ -101,6 +130,7 @@ public:
     for (size_t i = promoted + mixed; i < size; i++) {
       population[i] = unique_ptr(generator.makeRandom());
     }
+    calculateFitness(promoted, size);
 
     sort();
   }
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// A square matrix of small values, such as flags or counts, where most
+// entries are zero. While that takes a reasonable amount of memory it is
+// stored densely, which is fastest, and above that only the nonzero entries
+// are stored, in a hash map, so memory is not quadratic in the width.
+//
+
+#ifndef wasm_support_sparse_square_matrix_h
+#define wasm_support_sparse_square_matrix_h
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace wasm {
+
+template<typename T>
+class SparseSquareMatrix {
+  // matrices of up to this many bits are stored densely (note that a
+  // vector of bools is packed)
+  static const uint64_t DenseLimit = uint64_t(512) << 20;
+  static const uint64_t BitsPerEntry = std::is_same<T, bool>::value ? 1 : 8 * sizeof(T);
+
+  uint32_t n = 0;
+  bool dense = true;
+  std::vector<T> denseStorage;
+  std::vector<std::unordered_map<uint32_t, T>> sparseRows;
+
+public:
+  // Resets to a zero matrix of the given width.
+  void recreate(uint32_t width) {
+    n = width;
+    dense = uint64_t(width) * width * BitsPerEntry <= DenseLimit;
+    denseStorage.clear();
+    sparseRows.clear();
+    if (dense) {
+      denseStorage.resize(size_t(width) * width);
+    } else {
+      sparseRows.resize(width);
+    }
+  }
+
+  uint32_t width() const { return n; }
+
+  T get(uint32_t i, uint32_t j) const {
+    assert(i < n && j < n);
+    if (dense) return denseStorage[size_t(i) * n + j];
+    auto& row = sparseRows[i];
+    auto iter = row.find(j);
+    if (iter == row.end()) return T();
+    return iter->second;
+  }
+
+  void set(uint32_t i, uint32_t j, T value) {
+    assert(i < n && j < n);
+    if (dense) {
+      denseStorage[size_t(i) * n + j] = value;
+    } else if (value == T()) {
+      sparseRows[i].erase(j);
+    } else {
+      sparseRows[i][j] = value;
+    }
+  }
+
+  // Calls func(j, value) on the nonzero entries in row i, in no particular
+  // order.
+  template<typename F>
+  void forEachInRow(uint32_t i, F func) const {
+    assert(i < n);
+    if (dense) {
+      auto start = size_t(i) * n;
+      for (uint32_t j = 0; j < n; j++) {
+        T value = denseStorage[start + j];
+        if (value != T()) func(j, value);
+      }
+    } else {
+      for (auto& pair : sparseRows[i]) {
+        func(pair.first, pair.second);
+      }
+    }
+  }
+};
+
+} // namespace wasm
+
+#endif // wasm_support_sparse_square_matrix_h
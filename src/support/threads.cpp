@@ -43,6 +43,9 @@ namespace wasm {
 
 static std::unique_ptr<ThreadPool> pool;
 
+// Whether the current thread is one of the pool's helper threads
+static thread_local bool onPoolThread = false;
+
 
 // Thread
 
@@ -76,6 +79,7 @@ void Thread::work(std::function<ThreadWorkState ()> doWork_) {
 
 void Thread::mainLoop(void *self_) {
   auto* self = static_cast<Thread*>(self_);
+  onPoolThread = true;
   while (1) {
     DEBUG_THREAD("checking for work\n");
     {
@@ -85,6 +89,8 @@ void Thread::mainLoop(void *self_) {
         // run tasks until they are all done
         while (self->doWork() == ThreadWorkState::More) {}
         self->doWork = nullptr;
+        // help with nested work other threads are waiting on
+        while (ThreadPool::get()->runPendingTask()) {}
       } else if (self->done) {
         DEBUG_THREAD("done\n");
         return;
@@ -148,12 +154,28 @@ void ThreadPool::work(std::vector<std::function<ThreadWorkState ()>>& doWorkers)
     while (doWorkers[0]() == ThreadWorkState::More) {}
     return;
   }
+  // If we are already inside the pool, or another thread is using it, run
+  // the workers as nested tasks. Otherwise claim the threads for this call.
+  bool claimed = false;
+  if (!isPoolThread()) {
+    bool expected = false;
+    claimed = running.compare_exchange_strong(expected, true);
+  }
+  if (!claimed) {
+    DEBUG_POOL("work() nested\n");
+    TaskGroup group;
+    for (auto& doWorker : doWorkers) {
+      group.spawn([&doWorker]() {
+        while (doWorker() == ThreadWorkState::More) {}
+      });
+    }
+    group.wait();
+    return;
+  }
   // run in parallel on threads
   // TODO: fancy work stealing
   DEBUG_POOL("work() on threads\n");
   assert(doWorkers.size() == num);
-  assert(!running);
-  running = true;
   std::unique_lock<std::mutex> lock(mutex);
   resetThreadsAreReady();
   for (size_t i = 0; i < num; i++) {
@@ -174,6 +196,10 @@ bool ThreadPool::isRunning() {
   return pool && pool->running;
 }
 
+bool ThreadPool::isPoolThread() {
+  return onPoolThread;
+}
+
 void ThreadPool::notifyThreadIsReady() {
   DEBUG_POOL("notify thread is ready\n";)
   std::lock_guard<std::mutex> lock(mutex);
@@ -193,5 +219,164 @@ bool ThreadPool::areThreadsReady() {
   return ready.load() == threads.size();
 }
 
+void ThreadPool::addPendingTask(TaskGroup* group, std::function<void ()> task) {
+  std::lock_guard<std::mutex> lock(tasksMutex);
+  tasks.push_back({ group, task });
+}
+
+bool ThreadPool::runPendingTask(TaskGroup* group) {
+  PendingTask pending;
+  {
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    auto iter = tasks.begin();
+    if (group) {
+      iter = std::find_if(tasks.begin(), tasks.end(), [&](const PendingTask& task) {
+        return task.group == group;
+      });
+    }
+    if (iter == tasks.end()) return false;
+    pending = std::move(*iter);
+    tasks.erase(iter);
+  }
+  DEBUG_POOL("run pending task\n");
+  pending.task();
+  pending.group->notifyTaskIsDone();
+  return true;
+}
+
+// TaskGroup
+
+void TaskGroup::spawn(std::function<void ()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    unfinished++;
+  }
+  ThreadPool::get()->addPendingTask(this, task);
+}
+
+void TaskGroup::wait() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (unfinished == 0) return;
+  }
+  auto* pool = ThreadPool::get();
+  if (!ThreadPool::isPoolThread() && !ThreadPool::isRunning() && pool->threads.size() > 0) {
+    // we are outside of the pool, so send our tasks to its threads
+    std::vector<std::function<ThreadWorkState ()>> doWorkers;
+    for (size_t i = 0; i < pool->threads.size(); i++) {
+      doWorkers.push_back([this, pool]() {
+        return pool->runPendingTask(this) ? ThreadWorkState::More : ThreadWorkState::Finished;
+      });
+    }
+    pool->work(doWorkers);
+  }
+  // run our tasks that no one has started, then wait for the rest
+  while (pool->runPendingTask(this)) {}
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [this]() { return unfinished == 0; });
+}
+
+void TaskGroup::notifyTaskIsDone() {
+  std::lock_guard<std::mutex> lock(mutex);
+  assert(unfinished > 0);
+  unfinished--;
+  if (unfinished == 0) {
+    condition.notify_all();
+  }
+}
+
+// parallelFor
+
+size_t getNumParallelWorkers(size_t size) {
+  return std::max(size_t(1), std::min(size, ThreadPool::get()->size()));
+}
+
+void parallelFor(size_t size, std::function<void (size_t worker, size_t index)> work) {
+  size_t num = getNumParallelWorkers(size);
+  if (num == 1) {
+    for (size_t i = 0; i < size; i++) {
+      work(0, i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  TaskGroup tasks;
+  for (size_t worker = 0; worker < num; worker++) {
+    tasks.spawn([&, worker]() {
+      while (1) {
+        size_t index = next++;
+        if (index >= size) break;
+        work(worker, index);
+      }
+    });
+  }
+  tasks.wait();
+}
+
+// WorkStealingQueue
+
+WorkStealingQueue::WorkStealingQueue(size_t numWorkers) {
+  assert(numWorkers > 0);
+  for (size_t i = 0; i < numWorkers; i++) {
+    deques.emplace_back(make_unique<Deque>());
+  }
+  pending.store(0);
+}
+
+void WorkStealingQueue::addByCost(const std::vector<size_t>& costs) {
+  std::vector<size_t> order;
+  order.reserve(costs.size());
+  for (size_t i = 0; i < costs.size(); i++) {
+    order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return costs[a] > costs[b];
+  });
+  // deal them out like cards, so each worker starts on one of the
+  // largest tasks, and each deque is sorted from largest to smallest
+  for (auto task : order) {
+    push(task);
+  }
+}
+
+void WorkStealingQueue::push(size_t task) {
+  auto& deque = *deques[nextDeque];
+  pending.fetch_add(1); // before the task is visible, so the count never wraps
+  {
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    deque.tasks.push_back(task);
+  }
+  nextDeque = (nextDeque + 1) % deques.size();
+}
+
+bool WorkStealingQueue::pop(size_t worker, size_t& task) {
+  assert(worker < deques.size());
+  if (pending.load() == 0) return false;
+  // our own work first, from the front, where the largest tasks are
+  {
+    auto& deque = *deques[worker];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (!deque.tasks.empty()) {
+      task = deque.tasks.front();
+      deque.tasks.pop_front();
+      pending.fetch_sub(1);
+      return true;
+    }
+  }
+  // steal from the back of another worker's deque, where the smallest
+  // tasks are, which keeps the load balanced as things wind down
+  for (size_t i = 1; i < deques.size(); i++) {
+    auto& deque = *deques[(worker + i) % deques.size()];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (!deque.tasks.empty()) {
+      task = deque.tasks.back();
+      deque.tasks.pop_back();
+      pending.fetch_sub(1);
+      return true;
+    }
+  }
+  return false;
+}
+
 } // namespace wasm
 
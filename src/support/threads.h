@@ -23,6 +23,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -63,19 +64,35 @@ private:
   static void mainLoop(void *self);
 };
 
+class TaskGroup;
+
 //
 // A pool of helper threads.
 //
 // There is only one, to avoid recursive pools using too many cores.
+// Work can be nested, though: if work() is called from a pool thread,
+// or tasks are spawned in a TaskGroup, they are queued in the pool,
+// and run by the pool's threads as they become free, as well as by the
+// thread that waits for them.
 //
 
 class ThreadPool {
   std::vector<std::unique_ptr<Thread>> threads;
-  bool running = false;
+  // whether a top-level work() is using the threads. it is set by the thread
+  // that calls work(), and read by any thread
+  std::atomic<bool> running{false};
   std::mutex mutex;
   std::condition_variable condition;
   std::atomic<size_t> ready;
 
+  // tasks spawned in task groups, that no thread has started yet
+  struct PendingTask {
+    TaskGroup* group;
+    std::function<void ()> task;
+  };
+  std::mutex tasksMutex;
+  std::deque<PendingTask> tasks;
+
 private:
   void initialize(size_t num);
 
@@ -90,20 +107,132 @@ public:
   // Execute a bunch of tasks by the pool. This calls
   // getTask() (in a thread-safe manner) to get tasks, and
   // sends them to workers to be executed. This method
-  // blocks until all tasks are complete.
+  // blocks until all tasks are complete. This may be called
+  // from a pool thread, in which case the workers are run
+  // as tasks in a TaskGroup. The same is done if it is called
+  // from another thread while the pool's threads are already
+  // running a work() call: only one caller at a time gets the
+  // threads, and the others share them through tasks.
   void work(std::vector<std::function<ThreadWorkState ()>>& doWorkers);
 
   size_t size();
 
   static bool isRunning();
 
+  // Whether the current thread is one of the pool's helper threads.
+  static bool isPoolThread();
+
   // Called by helper threads when they are free and ready.
   void notifyThreadIsReady();
 
+  // Run a task that was spawned in a task group, if there is one.
+  // If a group is given, only its tasks are considered. Returns
+  // whether a task was run.
+  bool runPendingTask(TaskGroup* group = nullptr);
+
 private:
   void resetThreadsAreReady();
 
   bool areThreadsReady();
+
+  friend class TaskGroup;
+
+  void addPendingTask(TaskGroup* group, std::function<void ()> task);
+};
+
+//
+// A group of tasks that are spawned and then waited on together, which
+// allows nested parallelism without creating more threads. Usage:
+//
+//    TaskGroup group;
+//    group.spawn([&]() { .. });
+//    group.spawn([&]() { .. });
+//    group.wait();
+//
+// Spawned tasks are queued in the ThreadPool. Pool threads that are free
+// run them, and the thread that waits helps by running the group's tasks
+// itself, so waiting on a pool thread cannot deadlock. When wait() is
+// called outside of the pool, the group's tasks are sent to the pool's
+// threads. Tasks may spawn and wait on their own groups.
+//
+
+class TaskGroup {
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t unfinished = 0;
+
+public:
+  TaskGroup() {}
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  ~TaskGroup() {
+    wait();
+  }
+
+  void spawn(std::function<void ()> task);
+
+  // Blocks until all the spawned tasks are complete.
+  void wait();
+
+private:
+  friend class ThreadPool;
+
+  void notifyTaskIsDone();
+};
+
+//
+// Runs work(worker, index) for each index from 0 to size - 1, in parallel,
+// as tasks in a TaskGroup. The workers are numbered from 0 to
+// getNumParallelWorkers(size) - 1, and each takes the next index when it
+// is free, so state that a worker reuses between indexes can be kept in a
+// vector with an entry per worker. With a single worker, everything runs
+// on the calling thread.
+//
+
+size_t getNumParallelWorkers(size_t size);
+
+void parallelFor(size_t size, std::function<void (size_t worker, size_t index)> work);
+
+//
+// A work-stealing queue of task indexes.
+//
+// Each worker has its own deque of tasks, and takes tasks from the front
+// of it. When a worker's deque is empty, it steals from the back of
+// another worker's deque, so all workers stay busy until the very end.
+// When the cost of the tasks can be estimated up front, adding them by
+// cost makes the most expensive tasks start first, which avoids one large
+// task being started last and running alone while the other workers idle.
+//
+
+class WorkStealingQueue {
+  struct Deque {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+  std::vector<std::unique_ptr<Deque>> deques;
+  std::atomic<size_t> pending;
+  size_t nextDeque = 0; // where push() adds the next task
+
+public:
+  WorkStealingQueue(size_t numWorkers);
+
+  // Add the tasks 0 .. costs.size() - 1, ordered so that the ones with the
+  // highest estimated cost are started first. Ties keep their index order.
+  void addByCost(const std::vector<size_t>& costs);
+
+  // Add a single task, distributing them round-robin among the workers.
+  // This must only be called from one thread at a time, but it is safe to
+  // call while workers are popping.
+  void push(size_t task);
+
+  // Get the next task for a worker, stealing it from another worker if
+  // necessary. Returns false if no tasks are left.
+  bool pop(size_t worker, size_t& task);
+
+  bool empty() {
+    return pending.load() == 0;
+  }
 };
 
 // Verify a code segment is only entered once. Usage:
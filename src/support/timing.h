@@ -22,29 +22,57 @@
 #define wasm_support_timing_h
 
 #include <chrono>
+#include <ctime>
+#include <iostream>
+#include <string>
 
 namespace wasm {
 
+// CPU time used so far by the whole process, in seconds
+inline double getProcessCPUTime() {
+  return double(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// CPU time used so far by the calling thread, in seconds
+inline double getThreadCPUTime() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+  return getProcessCPUTime(); // no per-thread clock here
+#endif
+}
+
+// Measures wall time, and the CPU time of the thread that starts and stops it
 class Timer {
   std::string name;
   std::chrono::steady_clock::time_point startTime;
+  double startCPUTime = 0;
   double total = 0;
+  double totalCPU = 0;
 
 public:
-  Timer(std::string name) : name(name) {}
+  Timer(std::string name = "") : name(name) {}
 
   void start() {
     startTime = std::chrono::steady_clock::now();
+    startCPUTime = getThreadCPUTime();
   }
 
   void stop() {
     total += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    totalCPU += getThreadCPUTime() - startCPUTime;
   }
 
   double getTotal() {
     return total;
   }
 
+  double getCPUTotal() {
+    return totalCPU;
+  }
+
   void dump() {
     std::cerr << "<Timer " << name << ": " << getTotal() << ">\n";
   }
@@ -81,4 +81,9 @@
            [&passOptions](Options*, const std::string&) {
              passOptions.ignoreImplicitTraps = true;
            })
+      .add("--learning-time-budget", "-ltb", "Milliseconds that learning passes, like coalesce-locals-learning, may search for on each function (0, the default, means no limit)",
+           Options::Arguments::One,
+           [&passOptions](Options* o, const std::string& argument) {
+             passOptions.learningTimeBudget = atoi(argument.c_str());
+           })
 
@@ -66,7 +66,7 @@ int main(int argc, const char *argv[]) {
 
   try {
     if (options.debug) std::cerr << "s-parsing..." << std::endl;
-    SExpressionParser parser(const_cast<char*>(input.c_str()));
+    SExpressionParser parser(input.c_str());
     Element& root = *parser.root;
     if (options.debug) std::cerr << "w-parsing..." << std::endl;
     SExpressionWasmBuilder builder(wasm, *root[0]);
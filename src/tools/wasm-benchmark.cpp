@@ -0,0 +1,318 @@
+/*
+ * Copyright 2017 WebAssembly Community Group participants
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Times parts of binaryen on a module, to compare changes to them. Run it
+// on a large module. Nothing is written out.
+//
+
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include "parsing.h"
+#include "support/command-line.h"
+#include "support/timing.h"
+#include "shell-interface.h"
+#include "wasm-binary.h"
+#include "wasm-builder.h"
+#include "wasm-io.h"
+#include "wasm-printing.h"
+#include "wasm-s-parser.h"
+#include "wasm-traversal.h"
+
+using namespace wasm;
+
+//
+// Walkers: times walking the module with each kind of walker that passes
+// are built on. Each function is walked by a new walker, as function-parallel
+// passes do, and the visitors do nothing, so this measures just the
+// traversal.
+//
+
+struct PlainWalker : public PostWalker<PlainWalker> {};
+
+struct UnifiedWalker : public PostWalker<UnifiedWalker, UnifiedExpressionVisitor<UnifiedWalker>> {};
+
+struct ControlFlowStackWalker : public ControlFlowWalker<ControlFlowStackWalker> {};
+
+struct ExpressionStackOnlyWalker : public ExpressionStackWalker<ExpressionStackOnlyWalker> {};
+
+struct LinearWalker : public LinearExecutionWalker<LinearWalker> {
+  void noteNonLinear(Expression* curr) {}
+};
+
+// how many times we walk the module with each walker
+static const Index WalkerRounds = 10;
+
+template<typename T>
+static void timeWalker(const char* name, Module& wasm) {
+  Timer timer;
+  timer.start();
+  for (Index i = 0; i < WalkerRounds; i++) {
+    for (auto& func : wasm.functions) {
+      T walker;
+      walker.setModule(&wasm);
+      walker.walkFunction(func.get());
+    }
+  }
+  timer.stop();
+  std::cout << " " << std::left << std::setw(17) << name << ": " << timer.getTotal() << " s\n";
+}
+
+static void benchmarkWalkers(Module& wasm) {
+  std::cout << "Walker times (" << WalkerRounds << " rounds)\n";
+  timeWalker<PlainWalker>("post", wasm);
+  timeWalker<UnifiedWalker>("post-unified", wasm);
+  timeWalker<ControlFlowStackWalker>("control-flow", wasm);
+  timeWalker<ExpressionStackOnlyWalker>("expression-stack", wasm);
+  timeWalker<LinearWalker>("linear-execution", wasm);
+}
+
+//
+// Parser: times reading the text format. The module is printed, and the text
+// is parsed into s-expressions and then built into a new module, several
+// times, and the throughput of each step is reported.
+//
+
+// how many times we parse the module
+static const Index ParserRounds = 5;
+
+static void reportParser(const char* name, Timer& timer, double megabytes) {
+  std::cout << " " << std::left << std::setw(14) << name << ": " << timer.getTotal() << " s, "
+            << megabytes / timer.getTotal() << " MB/s\n";
+}
+
+static void benchmarkParser(Module& wasm) {
+  std::stringstream stream;
+  WasmPrinter::printModule(&wasm, stream);
+  std::string text = stream.str();
+  double megabytes = double(text.size()) * ParserRounds / (1024 * 1024);
+
+  Timer parsing, building;
+  for (Index i = 0; i < ParserRounds; i++) {
+    parsing.start();
+    SExpressionParser parser(text.c_str());
+    parsing.stop();
+    building.start();
+    Module other;
+    SExpressionWasmBuilder builder(other, *(*parser.root)[0]);
+    building.stop();
+  }
+
+  std::cout << "Parser times (" << ParserRounds << " rounds of " << text.size() << " bytes)\n";
+  reportParser("s-expressions", parsing, megabytes);
+  reportParser("module", building, megabytes);
+}
+
+//
+// LEBs: times reading the module's binary format, and decoding LEBs on their
+// own. The LEBs are the immediates of the module's code (local indexes,
+// call targets, memory offsets and constants), encoded one after another,
+// and are decoded both from the buffer directly, as WasmBinaryBuilder does,
+// and through a bounds-checked std::function per byte, as it used to.
+//
+
+// how many times we read the binary, and decode the LEBs
+static const Index BinaryRounds = 20;
+static const Index LEBRounds = 1000;
+
+struct LEBCollector : public PostWalker<LEBCollector> {
+  std::map<Name, Index> functionIndexes;
+  std::vector<uint32_t> unsigned32;
+  std::vector<int32_t> signed32;
+  std::vector<int64_t> signed64;
+
+  void visitCall(Call* curr) { unsigned32.push_back(functionIndexes[curr->target]); }
+  void visitGetLocal(GetLocal* curr) { unsigned32.push_back(curr->index); }
+  void visitSetLocal(SetLocal* curr) { unsigned32.push_back(curr->index); }
+  void visitLoad(Load* curr) { unsigned32.push_back(curr->offset); }
+  void visitStore(Store* curr) { unsigned32.push_back(curr->offset); }
+  void visitConst(Const* curr) {
+    if (curr->type == i32) signed32.push_back(curr->value.geti32());
+    if (curr->type == i64) signed64.push_back(curr->value.geti64());
+  }
+};
+
+template<typename T, typename MiniT>
+static void timeLEBs(const char* name, const std::vector<T>& values) {
+  std::vector<uint8_t> bytes;
+  for (auto value : values) {
+    LEB<T, MiniT>(value).write(&bytes);
+  }
+  if (bytes.empty()) return;
+  double megabytes = double(bytes.size()) * LEBRounds / (1024 * 1024);
+  Timer direct, generic;
+  T directSum = 0, genericSum = 0;
+  for (Index i = 0; i < LEBRounds; i++) {
+    direct.start();
+    const uint8_t* ptr = bytes.data();
+    const uint8_t* end = ptr + bytes.size();
+    while (ptr < end) {
+      LEB<T, MiniT> leb;
+      ptr = leb.read(ptr, end);
+      directSum += leb.value;
+    }
+    direct.stop();
+    generic.start();
+    size_t pos = 0;
+    std::function<MiniT ()> get = [&]() {
+      if (pos >= bytes.size()) throw ParseException("unexpected end of input");
+      return MiniT(bytes[pos++]);
+    };
+    while (pos < bytes.size()) {
+      LEB<T, MiniT> leb;
+      leb.read(get);
+      genericSum += leb.value;
+    }
+    generic.stop();
+  }
+  if (directSum != genericSum) Fatal() << "LEB decoders disagree on " << name;
+  std::cout << " " << std::left << std::setw(4) << name << ": " << values.size() << " values in " << bytes.size() << " bytes, "
+            << megabytes / direct.getTotal() << " MB/s direct, "
+            << megabytes / generic.getTotal() << " MB/s per byte\n";
+}
+
+static void benchmarkLEBs(Module& wasm) {
+  BufferWithRandomAccess buffer(false);
+  WasmBinaryWriter writer(&wasm, buffer, false);
+  writer.write();
+  std::vector<char> binary(buffer.begin(), buffer.end());
+  Timer reading;
+  for (Index i = 0; i < BinaryRounds; i++) {
+    reading.start();
+    Module other;
+    WasmBinaryBuilder builder(other, binary, false);
+    builder.read();
+    reading.stop();
+  }
+  std::cout << "Binary times (" << BinaryRounds << " rounds of " << binary.size() << " bytes)\n";
+  std::cout << " read: " << reading.getTotal() << " s, "
+            << double(binary.size()) * BinaryRounds / (1024 * 1024) / reading.getTotal() << " MB/s\n";
+
+  LEBCollector collector;
+  Index index = 0;
+  for (auto& import : wasm.imports) {
+    if (import->kind == ExternalKind::Function) collector.functionIndexes[import->name] = index++;
+  }
+  for (auto& func : wasm.functions) {
+    collector.functionIndexes[func->name] = index++;
+  }
+  collector.walkModule(&wasm);
+  std::cout << "LEB times (" << LEBRounds << " rounds)\n";
+  timeLEBs<uint32_t, uint8_t>("u32", collector.unsigned32);
+  timeLEBs<int32_t, int8_t>("s32", collector.signed32);
+  timeLEBs<int64_t, int8_t>("s64", collector.signed64);
+}
+
+//
+// Calls: times the interpreter on a recursive fib function, which does
+// little besides calling, and reports how many calls it runs per second.
+//
+
+// which fib we compute, making 2 * fib(FibInput + 1) - 1 calls
+static const int32_t FibInput = 30;
+
+static int32_t fib(int32_t n) {
+  int32_t a = 0, b = 1;
+  for (int32_t i = 0; i < n; i++) {
+    int32_t next = a + b;
+    a = b;
+    b = next;
+  }
+  return a;
+}
+
+static void benchmarkCalls() {
+  Module wasm;
+  Builder builder(wasm);
+  // (if (i32.lt_s n 2) n (i32.add (fib (n - 1)) (fib (n - 2))))
+  auto fibOf = [&](int32_t delta) {
+    return builder.makeCall("fib", {
+      builder.makeBinary(SubInt32, builder.makeGetLocal(0, i32), builder.makeConst(Literal(delta)))
+    }, i32);
+  };
+  auto* body = builder.makeIf(
+    builder.makeBinary(LtSInt32, builder.makeGetLocal(0, i32), builder.makeConst(Literal(int32_t(2)))),
+    builder.makeGetLocal(0, i32),
+    builder.makeBinary(AddInt32, fibOf(1), fibOf(2))
+  );
+  wasm.addFunction(builder.makeFunction("fib", { NameType("n", i32) }, i32, {}, body));
+  auto* export_ = new Export;
+  export_->name = export_->value = "fib";
+  export_->kind = ExternalKind::Function;
+  wasm.addExport(export_);
+
+  ShellExternalInterface interface;
+  ModuleInstance instance(wasm, &interface);
+  LiteralList arguments = { Literal(FibInput) };
+  Timer timer;
+  timer.start();
+  Literal result = instance.callExport("fib", arguments);
+  timer.stop();
+  if (result.geti32() != fib(FibInput)) Fatal() << "fib computed " << result.geti32();
+  double calls = 2.0 * fib(FibInput + 1) - 1;
+  std::cout << "Call times (fib(" << FibInput << "))\n";
+  std::cout << " " << timer.getTotal() << " s, " << calls / timer.getTotal() << " calls/s\n";
+}
+
+//
+// main
+//
+
+int main(int argc, const char* argv[]) {
+  bool walkers = false;
+  bool parser = false;
+  bool calls = false;
+  bool lebs = false;
+  Options options("wasm-benchmark", "Time parts of binaryen on a module (this is for developing binaryen, and does not write anything)");
+  options
+      .add("--walkers", "", "Time walking the module with each kind of walker",
+           Options::Arguments::Zero,
+           [&](Options* o, const std::string& argument) { walkers = true; })
+      .add("--parser", "", "Time parsing the module from the text format",
+           Options::Arguments::Zero,
+           [&](Options* o, const std::string& argument) { parser = true; })
+      .add("--leb", "", "Time reading the module from the binary format, and decoding the LEBs of its code",
+           Options::Arguments::Zero,
+           [&](Options* o, const std::string& argument) { lebs = true; })
+      .add("--calls", "", "Time calls in the interpreter, on a module it builds (so INFILE is not needed)",
+           Options::Arguments::Zero,
+           [&](Options* o, const std::string& argument) { calls = true; })
+      .add_positional("INFILE", Options::Arguments::Optional,
+                      [](Options* o, const std::string& argument) {
+                        o->extra["infile"] = argument;
+                      });
+  options.parse(argc, argv);
+
+  if (walkers || parser || lebs) {
+    if (options.extra.count("infile") == 0) Fatal() << "--walkers, --parser and --leb need an INFILE";
+    Module wasm;
+    ModuleReader reader;
+    reader.setDebug(options.debug);
+    try {
+      reader.read(options.extra["infile"], wasm);
+    } catch (ParseException& p) {
+      p.dump(std::cerr);
+      Fatal() << "error in parsing input";
+    }
+
+    if (walkers) benchmarkWalkers(wasm);
+    if (parser) benchmarkParser(wasm);
+    if (lebs) benchmarkLEBs(wasm);
+  }
+  if (calls) benchmarkCalls();
+}
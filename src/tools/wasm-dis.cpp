@@ -41,12 +41,12 @@ int main(int argc, const char *argv[]) {
                       });
   options.parse(argc, argv);
 
-  auto input(read_file<std::vector<char>>(options.extra["infile"], Flags::Binary, options.debug ? Flags::Debug : Flags::Release));
+  MappedFile input(options.extra["infile"], Flags::Binary, options.debug ? Flags::Debug : Flags::Release);
 
   if (options.debug) std::cerr << "parsing binary..." << std::endl;
   Module wasm;
   try {
-    WasmBinaryBuilder parser(wasm, input, options.debug);
+    WasmBinaryBuilder parser(wasm, input.data(), input.size(), options.debug);
     parser.read();
   } catch (ParseException& p) {
     p.dump(std::cerr);
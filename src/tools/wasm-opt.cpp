@@ -28,6 +28,7 @@
 #include "wasm-s-parser.h"
 #include "wasm-validator.h"
 #include "wasm-io.h"
+#include "optimization-cache.h"
 
 using namespace wasm;
 
@@ -42,6 +43,8 @@ int main(int argc, const char* argv[]) {
   PassOptions passOptions;
   bool emitBinary = true;
   bool debugInfo = false;
+  bool streamingOutput = false;
+  bool minimalSizes = false;
 
   Options options("wasm-opt", "Optimize .wast files");
   options
@@ -58,6 +61,18 @@ int main(int argc, const char* argv[]) {
       .add("--debuginfo", "-g", "Emit names section and debug info",
            Options::Arguments::Zero,
            [&](Options *o, const std::string &arguments) { debugInfo = true; })
+      .add("--streaming-output", "", "Write binary output section by section, without keeping all of it in memory",
+           Options::Arguments::Zero,
+           [&](Options *o, const std::string &arguments) { streamingOutput = true; })
+      .add("--minimal-sizes", "", "Encode section and function body sizes in binary output in as few bytes as possible",
+           Options::Arguments::Zero,
+           [&](Options *o, const std::string &arguments) { minimalSizes = true; })
+      .add("--pass-profile", "", "Write a profile of the time, memory and node count changes of each pass on each function to a file (CSV if it ends with .csv, otherwise JSON, which also has the hits and misses of --cache-dir)",
+           Options::Arguments::One,
+           [](Options *o, const std::string &argument) { o->extra["pass-profile"] = argument; })
+      .add("--cache-dir", "", "Cache optimized functions in this directory, and reuse them when optimizing the same functions again",
+           Options::Arguments::One,
+           [](Options *o, const std::string &argument) { o->extra["cache-dir"] = argument; })
       .add_positional("INFILE", Options::Arguments::One,
                       [](Options* o, const std::string& argument) {
                         o->extra["infile"] = argument;
@@ -76,8 +91,6 @@ int main(int argc, const char* argv[]) {
     passes[0] = "O";
   }
 
-  auto input(read_file<std::string>(options.extra["infile"], Flags::Text, options.debug ? Flags::Debug : Flags::Release));
-
   Module wasm;
 
   {
@@ -101,6 +114,13 @@ int main(int argc, const char* argv[]) {
     if (options.debug) std::cerr << "running passes...\n";
     PassRunner passRunner(&wasm, passOptions);
     if (options.debug) passRunner.setDebug(true);
+    PassProfile profile;
+    if (options.extra.count("pass-profile") > 0) passRunner.setProfile(&profile);
+    std::unique_ptr<OptimizationCache> cache;
+    if (options.extra.count("cache-dir") > 0) {
+      cache = make_unique<OptimizationCache>(options.extra["cache-dir"]);
+      passRunner.setCache(cache.get());
+    }
     for (auto& passName : passes) {
       if (passName == "O") {
         passRunner.addDefaultOptimizationPasses();
@@ -109,6 +129,15 @@ int main(int argc, const char* argv[]) {
       }
     }
     passRunner.run();
+    if (options.extra.count("pass-profile") > 0) {
+      auto& filename = options.extra["pass-profile"];
+      Output output(filename, Flags::Text, options.debug ? Flags::Debug : Flags::Release);
+      if (filename.size() >= 4 && filename.substr(filename.size() - 4) == ".csv") {
+        profile.dumpCSV(output.getStream());
+      } else {
+        profile.dumpJSON(output.getStream());
+      }
+    }
     assert(WasmValidator().validate(wasm));
   }
 
@@ -118,6 +147,8 @@ int main(int argc, const char* argv[]) {
     writer.setDebug(options.debug);
     writer.setBinary(emitBinary);
     writer.setDebugInfo(debugInfo);
+    writer.setStreaming(streamingOutput);
+    writer.setMinimalSizes(minimalSizes);
     writer.write(wasm, options.extra["output"]);
   }
 }
@@ -80,7 +80,22 @@ struct LEB {
     } while (more);
   }
 
-  void read(std::function<MiniT()> get) {
+  // the number of bytes in the minimal encoding
+  size_t size() {
+    T temp = value;
+    size_t ret = 0;
+    bool more;
+    do {
+      MiniT byte = temp & 127;
+      temp >>= 7;
+      more = hasMore(temp, byte);
+      ret++;
+    } while (more);
+    return ret;
+  }
+
+  template<typename Get>
+  void read(Get get) {
     value = 0;
     T shift = 0;
     MiniT byte;
@@ -114,6 +129,35 @@ struct LEB {
       }
     }
   }
+
+  // Reads from the bytes in [ptr, end), and returns where the value ends.
+  // Most values fit in one or two bytes, which are decoded directly; longer
+  // ones are decoded byte by byte, up to the longest encoding of T.
+  const uint8_t* read(const uint8_t* ptr, const uint8_t* end) {
+    if (ptr < end && !(ptr[0] & 128)) {
+      value = ptr[0];
+      if (std::is_signed<T>::value && (ptr[0] & 64)) {
+        value -= T(1) << 7;
+      }
+      return ptr + 1;
+    }
+    if (end - ptr >= 2 && !(ptr[1] & 128)) {
+      value = T(ptr[0] & 127) | (T(ptr[1]) << 7);
+      if (std::is_signed<T>::value && (ptr[1] & 64)) {
+        value -= T(1) << 14;
+      }
+      return ptr + 2;
+    }
+    const size_t maxBytes = (sizeof(T) * 8 + 6) / 7;
+    auto* stop = size_t(end - ptr) > maxBytes ? ptr + maxBytes : end;
+    read([&]() {
+      if (ptr == stop) {
+        throw ParseException(ptr == end ? "unexpected end of input" : "LEB overflow");
+      }
+      return MiniT(*ptr++);
+    });
+    return ptr;
+  }
 };
 
 typedef LEB<uint32_t, uint8_t> U32LEB;
@@ -533,6 +577,9 @@ class WasmBinaryWriter : public Visitor<WasmBinaryWriter, void> {
   bool debugInfo = true;
   std::string symbolMap;
 
+  bool minimalSizes = false;
+  std::ostream* streamTo = nullptr;
+
   MixedArena allocator;
 
   void prepare();
@@ -540,13 +587,25 @@ public:
   WasmBinaryWriter(Module* input, BufferWithRandomAccess& o, bool debug) : wasm(input), o(o), debug(debug) {
     prepare();
   }
+  // a writer of function bodies on behalf of another, on a worker thread
+  WasmBinaryWriter(WasmBinaryWriter& parent, BufferWithRandomAccess& o) : wasm(parent.wasm), o(o), debug(parent.debug), mappedFunctions(parent.mappedFunctions), mappedGlobals(parent.mappedGlobals) {}
 
   void setDebugInfo(bool set) { debugInfo = set; }
   void setSymbolMap(std::string set) { symbolMap = set; }
+  // encode section and function body sizes in as few bytes as possible,
+  // instead of a fixed 5, at the cost of moving their contents once
+  void setMinimalSizes(bool set) { minimalSizes = set; }
+  // write each section to the stream as soon as it is finished, instead of
+  // keeping the whole binary in the buffer, which then only holds one section
+  // at a time (and just one function body of the code section)
+  void setOutputStream(std::ostream* set) { streamTo = set; }
 
   void write();
   void writeHeader();
   int32_t writeU32LEBPlaceholder();
+  void writeSizeAt(size_t pos, uint32_t size);
+  void writeSize(uint32_t size);
+  void flush();
   void writeResizableLimits(Address initial, Address maximum, bool hasMaximum);
   int32_t startSection(BinaryConsts::Section code);
   void finishSection(int32_t start);
@@ -565,6 +624,10 @@ public:
   void writeFunctionSignatures();
   void writeExpression(Expression* curr);
   void writeFunctions();
+  void writeFunctionBody(Function* function);
+  // function bodies are independent, so we can encode them in parallel, each
+  // into its own buffer. if bodies is null, we just find their sizes
+  void encodeFunctionBodies(std::vector<std::vector<uint8_t>>* bodies, std::vector<uint32_t>& sizes);
   void writeGlobals();
   void writeExports();
   void writeDataSegments();
@@ -634,18 +697,27 @@ public:
 class WasmBinaryBuilder {
   Module& wasm;
   MixedArena& allocator;
-  std::vector<char>& input;
+  const char* input;
+  size_t inputSize;
   bool debug;
 
   size_t pos = 0;
   Index startIndex = -1;
 
 public:
-  WasmBinaryBuilder(Module& wasm, std::vector<char>& input, bool debug) : wasm(wasm), allocator(wasm.allocator), input(input), debug(debug) {}
+  WasmBinaryBuilder(Module& wasm, std::vector<char>& input, bool debug) : WasmBinaryBuilder(wasm, input.data(), input.size(), debug) {}
+  // the input is not copied, and must outlive the builder (it may be a
+  // mapped file, see MappedFile)
+  WasmBinaryBuilder(Module& wasm, const char* input, size_t inputSize, bool debug) : wasm(wasm), allocator(wasm.allocator), input(input), inputSize(inputSize), debug(debug) {}
+
+  // a builder that decodes function bodies on behalf of another, on a
+  // worker thread. it has its own decoding state, and records the calls it
+  // sees in its own functionCalls, which the parent merges afterwards
+  WasmBinaryBuilder(WasmBinaryBuilder& parent) : wasm(parent.wasm), allocator(parent.allocator), input(parent.input), inputSize(parent.inputSize), debug(parent.debug), functionImportIndexes(parent.functionImportIndexes), functionTypes(parent.functionTypes), mappedGlobals(parent.mappedGlobals) {}
 
   void read();
   void readUserSection(size_t payloadLen);
-  bool more() { return pos < input.size();}
+  bool more() { return pos < inputSize;}
 
   uint8_t getInt8();
   uint16_t getInt16();
@@ -654,6 +726,8 @@ public:
   // it is unsafe to return a float directly, due to ABI issues with the signalling bit
   Literal getFloat32Literal();
   Literal getFloat64Literal();
+  template<typename T, typename MiniT>
+  void readLEB(LEB<T, MiniT>& leb);
   uint32_t getU32LEB();
   uint64_t getU64LEB();
   int32_t getS32LEB();
@@ -694,6 +768,10 @@ public:
   Index endOfFunction = -1; // before we see a function (like global init expressions), there is no end of function to check
 
   void readFunctions();
+  // function bodies are length-prefixed, so after finding where each one is
+  // we can decode them in any order, and in parallel
+  void readFunctionBodiesInParallel(std::vector<size_t>& starts, std::vector<size_t>& ends);
+  Function* readFunctionBody(Index i, size_t start, size_t end);
 
   std::map<Export*, Index> exportIndexes;
   std::vector<Export*> exportOrder;
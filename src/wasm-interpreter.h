@@ -613,32 +613,51 @@ private:
   // stack traces.
   std::vector<Name> functionStack;
 
+  // The locals of all the functions on the stack, each function's right
+  // after its caller's, so a call does not allocate them.
+  std::vector<Literal> locals;
+
   // Call a function, starting an invocation.
   Literal callFunction(Name name, LiteralList& arguments) {
     // if the last call ended in a jump up the stack, it might have left stuff for us to clean up here
     callDepth = 0;
     functionStack.clear();
-    return callFunctionInternal(name, arguments);
+    // an import may call back into us while the frames that called it are
+    // still running, so keep their locals, and drop just what this
+    // invocation added
+    auto previousLocalsSize = locals.size();
+    Literal ret = callFunctionInternal(name, arguments);
+    locals.resize(previousLocalsSize);
+    return ret;
   }
 
 public:
   // Internal function call. Must be public so that callTable implementations can use it (refactor?)
   Literal callFunctionInternal(Name name, LiteralList& arguments) {
+    Function *function = wasm.getFunction(name);
+    assert(function);
+    return callFunctionInternal(function, arguments);
+  }
+
+  Literal callFunctionInternal(Function* function, LiteralList& arguments) {
 
+    // The locals of a call, in the instance's locals. They are accessed by
+    // index, as nested calls may reallocate the instance's locals.
     class FunctionScope {
      public:
-      std::vector<Literal> locals;
+      std::vector<Literal>& locals;
+      Index base;
       Function* function;
 
-      FunctionScope(Function* function, LiteralList& arguments)
-          : function(function) {
+      FunctionScope(std::vector<Literal>& locals, Function* function, LiteralList& arguments)
+          : locals(locals), base(locals.size()), function(function) {
         if (function->params.size() != arguments.size()) {
           std::cerr << "Function `" << function->name << "` expects "
                     << function->params.size() << " parameters, got "
                     << arguments.size() << " arguments." << std::endl;
           abort();
         }
-        locals.resize(function->getNumLocals());
+        locals.resize(base + function->getNumLocals());
         for (size_t i = 0; i < function->getNumLocals(); i++) {
           if (i < arguments.size()) {
             assert(function->isParam(i));
@@ -649,13 +668,21 @@ public:
                         << printWasmType(arguments[i].type) << "." << std::endl;
               abort();
             }
-            locals[i] = arguments[i];
+            locals[base + i] = arguments[i];
           } else {
             assert(function->isVar(i));
-            locals[i].type = function->getLocalType(i);
+            locals[base + i].type = function->getLocalType(i);
           }
         }
       }
+
+      ~FunctionScope() {
+        locals.resize(base);
+      }
+
+      Literal& getLocal(Index index) {
+        return locals[base + index];
+      }
     };
 
     // Executes expresions with concrete runtime info, the function and module at runtime
@@ -684,7 +711,7 @@ public:
         LiteralList arguments;
         Flow flow = generateArguments(curr->operands, arguments);
         if (flow.breaking()) return flow;
-        Flow ret = instance.callFunctionInternal(curr->target, arguments);
+        Flow ret = instance.callFunctionInternal(instance.wasm.getFunction(curr->target), arguments);
 #ifdef WASM_INTERPRETER_DEBUG
         std::cout << "(returned to " << scope.function->name << ")\n";
 #endif
@@ -712,8 +739,8 @@ public:
         NOTE_ENTER("GetLocal");
         auto index = curr->index;
         NOTE_EVAL1(index);
-        NOTE_EVAL1(scope.locals[index]);
-        return scope.locals[index];
+        NOTE_EVAL1(scope.getLocal(index));
+        return scope.getLocal(index);
       }
       Flow visitSetLocal(SetLocal *curr) {
         NOTE_ENTER("SetLocal");
@@ -723,7 +750,7 @@ public:
         NOTE_EVAL1(index);
         NOTE_EVAL1(flow.value);
         assert(curr->isTee() ? flow.value.type == curr->type : true);
-        scope.locals[index] = flow.value;
+        scope.getLocal(index) = flow.value;
         return curr->isTee() ? flow : Flow();
       }
 
@@ -807,11 +834,9 @@ public:
     auto previousCallDepth = callDepth;
     callDepth++;
     auto previousFunctionStackSize = functionStack.size();
-    functionStack.push_back(name);
+    functionStack.push_back(function->name);
 
-    Function *function = wasm.getFunction(name);
-    assert(function);
-    FunctionScope scope(function, arguments);
+    FunctionScope scope(locals, function, arguments);
 
 #ifdef WASM_INTERPRETER_DEBUG
     std::cout << "entering " << function->name
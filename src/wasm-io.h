@@ -46,11 +46,16 @@ public:
 class ModuleWriter : public ModuleIO {
   bool binary = true;
   bool debugInfo = false;
+  bool minimalSizes = false;
+  bool streaming = false;
   std::string symbolMap;
 
 public:
   void setBinary(bool binary_) { binary = binary_; }
   void setDebugInfo(bool debugInfo_) { debugInfo = debugInfo_; }
+  void setMinimalSizes(bool minimalSizes_) { minimalSizes = minimalSizes_; }
+  // write binary output section by section, see WasmBinaryWriter::setOutputStream
+  void setStreaming(bool streaming_) { streaming = streaming_; }
   void setSymbolMap(std::string symbolMap_) { symbolMap = symbolMap_; }
 
   // write text
@@ -323,7 +323,7 @@ extern "C" void EMSCRIPTEN_KEEPALIVE instantiate() {
             trap("callIndirect: bad argument type");
           }
         }
-        return instance.callFunctionInternal(func->name, arguments);
+        return instance.callFunctionInternal(func, arguments);
       } else {
         // A JS function JS can call
         prepareTempArgments(arguments);
@@ -48,22 +48,17 @@ static std::mutex debug;
 //        new functions to add (this also adds it to the module). Finally,
 //        call finish() when all functions have been added.
 //
-// This avoids locking by using atomics. We allocate an array of nullptrs
-// that represent all the functions, and as we add a function, we place it
-// at the next index. Each worker will read from the start to the end,
-// and when a non-nullptr is found, the worker optimizes that function and
-// nulls it. There is also an end marker that is not nullptr nor the address of
-// a valid function, which represents that beyond this point we have not
-// yet filled in. In other words,
-//    * the main thread fills everything with the end marker
-//    * the main thread transforms a marker entry into a function
-//    * workers pause when they see the marker
-//    * workers skip over nullptrs
-//    * workers transform functions into nullptrs, and optimize them
-//    * we keep an atomic count of the number of active workers and
-//      the number of optimized functions.
-//    * after adding a function, the main thread wakes up workers if
-//      it calculates there is work for them.
+// Functions are handed to the workers through a WorkStealingQueue. As
+// we add a function, we append it to our list and push its index to
+// the queue, which distributes them among the per-worker deques. A worker
+// takes work from its own deque, and steals from the others when its own
+// is empty, so no worker idles while there is anything left to optimize.
+// In more detail,
+//    * the main thread adds a function to the list, and pushes its index.
+//    * after adding a function, the main thread wakes up a worker in case
+//      it was sleeping.
+//    * workers pop tasks until the queue is empty, and then go to sleep
+//      until more are added, or until we are finishing.
 //    * a lock is used for going to sleep and waking up.
 // Locking should be rare, as optimization is
 // generally slower than generation; in the optimal case, we never
@@ -75,12 +70,12 @@ class OptimizingIncrementalModuleBuilder {
   uint32_t numFunctions;
   PassOptions passOptions;
   std::function<void (PassRunner&)> addPrePasses;
-  Function* endMarker;
-  std::atomic<Function*>* list;
+  std::vector<Function*> list;
   uint32_t nextFunction; // only used on main thread
   uint32_t numWorkers;
   std::vector<std::unique_ptr<std::thread>> threads;
-  std::atomic<uint32_t> liveWorkers, activeWorkers, availableFuncs, finishedFuncs;
+  std::unique_ptr<WorkStealingQueue> queue;
+  std::atomic<uint32_t> liveWorkers;
   std::mutex mutex;
   std::condition_variable condition;
   bool finishing;
@@ -91,9 +86,8 @@ public:
   // numFunctions must be equal to the number of functions allocated, or higher. Knowing
   // this bounds helps avoid locking.
   OptimizingIncrementalModuleBuilder(Module* wasm, Index numFunctions, PassOptions passOptions, std::function<void (PassRunner&)> addPrePasses, bool debug, bool validateGlobally)
-      : wasm(wasm), numFunctions(numFunctions), passOptions(passOptions), addPrePasses(addPrePasses), endMarker(nullptr), list(nullptr), nextFunction(0),
-        numWorkers(0), liveWorkers(0), activeWorkers(0), availableFuncs(0), finishedFuncs(0),
-        finishing(false), debug(debug), validateGlobally(validateGlobally) {
+      : wasm(wasm), numFunctions(numFunctions), passOptions(passOptions), addPrePasses(addPrePasses), nextFunction(0),
+        numWorkers(0), liveWorkers(0), finishing(false), debug(debug), validateGlobally(validateGlobally) {
     if (numFunctions == 0 || debug) {
       // if no functions to be optimized, or debug non-parallel mode, don't create any threads.
       return;
@@ -108,30 +102,18 @@ public:
     }
 
     // prepare work list
-    endMarker = new Function();
-    list = new std::atomic<Function*>[numFunctions];
-    for (uint32_t i = 0; i < numFunctions; i++) {
-      list[i].store(endMarker);
-    }
+    list.resize(numFunctions);
     // create workers
     DEBUG_THREAD("creating workers");
     numWorkers = ThreadPool::getNumCores();
     assert(numWorkers >= 1);
+    queue = make_unique<WorkStealingQueue>(numWorkers);
     liveWorkers.store(0);
-    activeWorkers.store(0);
     for (uint32_t i = 0; i < numWorkers; i++) { // TODO: one less, and add it at the very end, to not compete with main thread?
-      createWorker();
+      createWorker(i);
     }
     waitUntilAllReady();
     DEBUG_THREAD("workers are ready");
-    // prepare the rest of the initial state
-    availableFuncs.store(0);
-    finishedFuncs.store(0);
-  }
-
-  ~OptimizingIncrementalModuleBuilder() {
-    delete[] list;
-    delete endMarker;
   }
 
   // Add a function to the module, and to be optimized
@@ -139,11 +121,8 @@ public:
     wasm->addFunction(func);
     if (debug) return; // we optimize at the end if debugging
     queueFunction(func);
-    // wake workers if needed
-    auto wake = availableFuncs.load();
-    for (uint32_t i = 0; i < wake; i++) {
-      wakeWorker();
-    }
+    // wake a worker, in case they are all asleep
+    wakeWorker();
   }
 
   // All functions have been added, block until all are optimized, and then do
@@ -163,16 +142,15 @@ public:
     }
     DEBUG_THREAD("finish()ing");
     assert(nextFunction == numFunctions);
-    wakeAllWorkers();
     waitUntilAllFinished();
     optimizeGlobally();
     // TODO: clear side thread allocators from module allocator, as these threads were transient
   }
 
 private:
-  void createWorker() {
+  void createWorker(uint32_t index) {
     DEBUG_THREAD("create a worker");
-    threads.emplace_back(make_unique<std::thread>(workerMain, this));
+    threads.emplace_back(make_unique<std::thread>(workerMain, this, index));
   }
 
   void wakeWorker() {
@@ -181,12 +159,6 @@ private:
     condition.notify_one();
   }
 
-  void wakeAllWorkers() {
-    DEBUG_THREAD("wake all workers");
-    std::lock_guard<std::mutex> lock(mutex);
-    condition.notify_all();
-  }
-
   void waitUntilAllReady() {
     DEBUG_THREAD("wait until all workers are ready");
     std::unique_lock<std::mutex> lock(mutex);
@@ -200,6 +172,8 @@ private:
     {
       std::unique_lock<std::mutex> lock(mutex);
       finishing = true;
+      // wake any sleeping workers, so they see we are finishing
+      condition.notify_all();
       if (liveWorkers.load() > 0) {
         condition.wait(lock, [this]() { return liveWorkers.load() == 0; });
       }
@@ -212,8 +186,8 @@ private:
   void queueFunction(Function* func) {
     DEBUG_THREAD("queue function");
     assert(nextFunction < numFunctions); // TODO: if we are given more than we expected, use a slower work queue?
-    list[nextFunction++].store(func);
-    availableFuncs++;
+    list[nextFunction] = func;
+    queue->push(nextFunction++);
   }
 
   void optimizeGlobally() {
@@ -231,43 +205,33 @@ private:
     passRunner.runFunction(func);
   }
 
-  static void workerMain(OptimizingIncrementalModuleBuilder* self) {
+  static void workerMain(OptimizingIncrementalModuleBuilder* self, uint32_t index) {
     DEBUG_THREAD("workerMain");
     {
       std::lock_guard<std::mutex> lock(self->mutex);
       self->liveWorkers++;
-      self->activeWorkers++;
       self->condition.notify_all();
     }
-    for (uint32_t i = 0; i < self->numFunctions; i++) {
-      DEBUG_THREAD("workerMain iteration " << i);
-      if (self->list[i].load() == self->endMarker) {
-        // sleep, this entry isn't ready yet
-        DEBUG_THREAD("workerMain sleep");
-        self->activeWorkers--;
-        {
-          std::unique_lock<std::mutex> lock(self->mutex);
-          if (!self->finishing) { // while waiting for the lock, things may have ended
-            self->condition.wait(lock);
-          }
+    while (1) {
+      size_t task;
+      if (!self->queue->pop(index, task)) {
+        std::unique_lock<std::mutex> lock(self->mutex);
+        if (self->finishing && self->queue->empty()) {
+          break; // everything was added, and nothing is left
+        }
+        if (self->queue->empty()) {
+          // sleep until more work is added. the main thread adds work and then
+          // takes the lock to wake us, so we cannot miss a wakeup here
+          DEBUG_THREAD("workerMain sleep");
+          self->condition.wait(lock);
+          DEBUG_THREAD("workerMain continue");
         }
-        // continue
-        DEBUG_THREAD("workerMain continue");
-        self->activeWorkers++;
-        i--;
         continue;
       }
-      DEBUG_THREAD("workerMain exchange item");
-      auto* func = self->list[i].exchange(nullptr);
-      if (func == nullptr) {
-        DEBUG_THREAD("workerMain sees was already taken");
-        continue; // someone else has taken this one
-      }
       // we have work to do!
+      auto* func = self->list[task];
       DEBUG_THREAD("workerMain work on " << size_t(func));
-      self->availableFuncs--;
       self->optimizeFunction(func);
-      self->finishedFuncs++;
     }
     DEBUG_THREAD("workerMain ready to exit");
     {
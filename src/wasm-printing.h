@@ -37,6 +37,9 @@ struct WasmPrinter {
     return printModule(module, std::cout);
   }
 
+  // prints just a function of the module
+  static std::ostream& printFunction(Function* func, Module* module, std::ostream& o);
+
   static std::ostream& printExpression(Expression* expression, std::ostream& o, bool minify = false, bool full = false);
 };
 
@@ -31,12 +31,18 @@ namespace wasm {
 //
 // An element in an S-Expression: a list or a string
 //
+// A string is a slice of the parser's input, which is only interned when
+// str() or c_str() is called on it, so the many strings that never become
+// names in the IR, like numbers, are not interned.
+//
 class Element {
   typedef ArenaVector<Element*> List;
 
   bool isList_;
   List list_;
-  cashew::IString str_;
+  const char* text_;
+  size_t size_;
+  cashew::IString str_; // interned from the text, when needed
   bool dollared_;
   bool quoted_;
 
@@ -60,7 +66,10 @@ public:
   // string methods
   cashew::IString str();
   const char* c_str();
+  // a copy of the text of the string, without interning it
+  std::string text();
   Element* setString(cashew::IString str__, bool dollared__, bool quoted__);
+  Element* setString(const char* text__, size_t size__, bool dollared__, bool quoted__);
   Element* setMetadata(size_t line_, size_t col_);
 
   // printing
@@ -73,15 +82,16 @@ public:
 // Generic S-Expression parsing into lists
 //
 class SExpressionParser {
-  char* input;
+  const char* input;
   size_t line;
-  char* lineStart;
+  const char* lineStart;
 
   MixedArena allocator;
 
 public:
-  // Assumes control of and modifies the input.
-  SExpressionParser(char* input);
+  // The input is not modified, but it must outlive the elements, as their
+  // strings point into it.
+  SExpressionParser(const char* input);
   Element* root;
 
 private:
@@ -107,7 +117,21 @@ public:
   // Assumes control of and modifies the input.
   SExpressionWasmBuilder(Module& wasm, Element& module, Name* moduleName = nullptr);
 
+  // Parses just a function, which may refer to things in the module. The
+  // function is not added to the module, but returned in output.
+  SExpressionWasmBuilder(Module& wasm, Element& function, Function*& output);
+
+  // A builder that parses function bodies on behalf of another, on a worker
+  // thread. It has its own function parsing state, and reads the module
+  // state of the parent, which does not change while the bodies are parsed.
+  SExpressionWasmBuilder(SExpressionWasmBuilder& parent);
+
 private:
+  Function** functionOutput = nullptr;
+  // when parsing just a function, the labels we made up for unnamed blocks
+  // and loops, which we clear at the end to get back what was printed
+  std::vector<Name*> inventedLabels;
+
   // pre-parse types and function definitions, so we know function return types before parsing their contents
   void preParseFunctionType(Element& s);
   bool isImport(Element& curr);
@@ -124,6 +148,7 @@ private:
   UniqueNameMapper nameMapper;
 
   Name getFunctionName(Element& s);
+  WasmType getFunctionResult(Name name);
   Name getFunctionTypeName(Element& s);
   Name getGlobalName(Element& s);
   void parseStart(Element& s) { wasm.addStart(getFunctionName(*s[1]));}
@@ -131,6 +156,23 @@ private:
   // returns the next index in s
   size_t parseFunctionNames(Element& s, Name& name, Name& exportName);
   void parseFunction(Element& s, bool preParseImport = false);
+  // parses the rest of a function after its names, starting at index i in s.
+  // returns the function, or nullptr for an import, which is added to the
+  // module
+  Function* parseFunctionBody(Element& s, size_t i, Name name, bool preParseImport);
+
+  // The functions of a module, whose bodies are parsed after the rest of the
+  // module, when everything they may refer to is known, and which can then
+  // be parsed in parallel.
+  struct PendingFunction {
+    Element* s;
+    size_t i; // where the function continues after its names
+    Name name;
+  };
+  std::vector<PendingFunction> pendingFunctions;
+
+  void parseFunctionBodies();
+  void parseFunctionBodiesInParallel(std::vector<std::unique_ptr<Function>>& functions);
 
   WasmType stringToWasmType(cashew::IString str, bool allowError=false, bool prefix=false) {
     return stringToWasmType(str.str, allowError, prefix);
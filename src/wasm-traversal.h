@@ -261,6 +261,9 @@ struct Walker : public VisitorType {
 
   void walk(Expression*& root) {
     assert(stack.size() == 0);
+    if (stack.capacity() == 0) {
+      acquireStack();
+    }
     pushTask(SubType::scan, &root);
     while (stack.size() > 0) {
       auto task = popTask();
@@ -310,7 +313,39 @@ struct Walker : public VisitorType {
     currFunction = func;
   }
 
+  ~Walker() {
+    releaseStack();
+  }
+
 private:
+  // Function-parallel passes create a walker for each function, so rather
+  // than grow a new stack of tasks each time, each thread keeps the stack of
+  // the last walker of each type that it destroyed, and gives it to the next
+  // one.
+  enum { InitialStackSize = 64 };
+
+  static std::vector<Task>& getSpareStack() {
+    static thread_local std::vector<Task> spare;
+    return spare;
+  }
+
+  void acquireStack() {
+    auto& spare = getSpareStack();
+    if (spare.capacity() > 0) {
+      stack.swap(spare);
+    } else {
+      stack.reserve(InitialStackSize);
+    }
+  }
+
+  void releaseStack() {
+    auto& spare = getSpareStack();
+    if (stack.capacity() > spare.capacity()) {
+      stack.clear();
+      stack.swap(spare);
+    }
+  }
+
   Expression* replace = nullptr; // a node to replace
   std::vector<Task> stack; // stack of tasks
   Function* currFunction = nullptr; // current function being processed
@@ -323,6 +358,17 @@ private:
 template<typename SubType, typename VisitorType = Visitor<SubType>>
 struct PostWalker : public Walker<SubType, VisitorType> {
 
+  // A leaf has no children to scan first, so unless the subtype adds tasks
+  // of its own around each scan, it can be visited right away, without
+  // pushing a task to do so.
+  static void scanLeaf(SubType* self, Expression** currp, void (*doVisit)(SubType*, Expression**)) {
+    if (&SubType::scan == &PostWalker<SubType, VisitorType>::scan) {
+      doVisit(self, currp);
+    } else {
+      self->pushTask(doVisit, currp);
+    }
+  }
+
   static void scan(SubType* self, Expression** currp) {
 
     Expression* curr = *currp;
@@ -386,7 +432,7 @@ struct PostWalker : public Walker<SubType, VisitorType> {
         break;
       }
       case Expression::Id::GetLocalId: {
-        self->pushTask(SubType::doVisitGetLocal, currp); // TODO: optimize leaves with a direct call?
+        scanLeaf(self, currp, SubType::doVisitGetLocal);
         break;
       }
       case Expression::Id::SetLocalId: {
@@ -395,7 +441,7 @@ struct PostWalker : public Walker<SubType, VisitorType> {
         break;
       }
       case Expression::Id::GetGlobalId: {
-        self->pushTask(SubType::doVisitGetGlobal, currp);
+        scanLeaf(self, currp, SubType::doVisitGetGlobal);
         break;
       }
       case Expression::Id::SetGlobalId: {
@@ -415,7 +461,7 @@ struct PostWalker : public Walker<SubType, VisitorType> {
         break;
       }
       case Expression::Id::ConstId: {
-        self->pushTask(SubType::doVisitConst, currp);
+        scanLeaf(self, currp, SubType::doVisitConst);
         break;
       }
       case Expression::Id::UnaryId: {
@@ -455,11 +501,11 @@ struct PostWalker : public Walker<SubType, VisitorType> {
         break;
       }
       case Expression::Id::NopId: {
-        self->pushTask(SubType::doVisitNop, currp);
+        scanLeaf(self, currp, SubType::doVisitNop);
         break;
       }
       case Expression::Id::UnreachableId: {
-        self->pushTask(SubType::doVisitUnreachable, currp);
+        scanLeaf(self, currp, SubType::doVisitUnreachable);
         break;
       }
       default: WASM_UNREACHABLE();
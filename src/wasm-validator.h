@@ -37,9 +37,14 @@
 #ifndef wasm_wasm_validator_h
 #define wasm_wasm_validator_h
 
+#include <atomic>
 #include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "support/colors.h"
+#include "support/threads.h"
 #include "wasm.h"
 #include "wasm-printing.h"
 
@@ -52,6 +57,9 @@ struct WasmValidator : public PostWalker<WasmValidator> {
   bool validateWeb = false;
   bool validateGlobally = true;
 
+  // where errors are printed
+  std::ostream* stream = &std::cerr;
+
   struct BreakInfo {
     WasmType type;
     Index arity;
@@ -59,23 +67,26 @@ struct WasmValidator : public PostWalker<WasmValidator> {
     BreakInfo(WasmType type, Index arity) : type(type), arity(arity) {}
   };
 
-  std::map<Name, std::vector<Expression*>> breakTargets; // more than one block/loop may use a label name, so stack them
-  std::map<Expression*, BreakInfo> breakInfos;
+  std::unordered_map<Name, std::vector<Expression*>> breakTargets; // more than one block/loop may use a label name, so stack them
+  std::unordered_map<Expression*, BreakInfo> breakInfos;
 
   WasmType returnType = unreachable; // type used in returns
 
-  std::set<Name> labelNames; // Binaryen IR requires that label names must be unique - IR generators must ensure that
+  std::unordered_set<Name> labelNames; // Binaryen IR requires that label names must be unique - IR generators must ensure that
 
   void noteLabelName(Name name) {
     if (!name.is()) return;
-    shouldBeTrue(labelNames.find(name) == labelNames.end(), name, "names in Binaren IR must be unique - IR generators must ensure that");
-    labelNames.insert(name);
+    shouldBeTrue(labelNames.insert(name).second, name, "names in Binaren IR must be unique - IR generators must ensure that");
   }
 
+  // the functions to validate, or all of them if null
+  const std::vector<Function*>* functions = nullptr;
+
 public:
   bool validate(Module& module, bool validateWeb_ = false, bool validateGlobally_ = true) {
     validateWeb = validateWeb_;
     validateGlobally = validateGlobally_;
+    functions = nullptr;
     walkModule(&module);
     if (!valid) {
       WasmPrinter::printModule(&module, std::cerr);
@@ -83,6 +94,94 @@ public:
     return valid;
   }
 
+  // Validates only the given functions, and the module-level parts of the
+  // module. This is enough after a change that can only have affected those
+  // functions, see IncrementalValidator.
+  bool validate(Module& module, const std::vector<Function*>& functions_, bool validateWeb_ = false, bool validateGlobally_ = true) {
+    validateWeb = validateWeb_;
+    validateGlobally = validateGlobally_;
+    functions = &functions_;
+    walkModule(&module);
+    functions = nullptr;
+    if (!valid) {
+      WasmPrinter::printModule(&module, std::cerr);
+    }
+    return valid;
+  }
+
+  // The module-level parts are validated here, and the functions in
+  // parallel, each thread with its own validator. Functions only read the
+  // module, so that is safe. The errors of each function are buffered and
+  // printed in order afterwards, so the output is the same as when
+  // validating on one thread. Errors print expressions on the pool's
+  // threads, which is safe as long as printing keeps no shared state (like
+  // JSPrinter::numToString's buffers, which are per thread).
+  void doWalkModule(Module* module) {
+    for (auto& curr : module->functionTypes) {
+      visitFunctionType(curr.get());
+    }
+    for (auto& curr : module->imports) {
+      visitImport(curr.get());
+    }
+    for (auto& curr : module->exports) {
+      visitExport(curr.get());
+    }
+    for (auto& curr : module->globals) {
+      walkGlobal(curr.get());
+    }
+    if (functions) {
+      validateFunctions(module, *functions);
+    } else {
+      std::vector<Function*> all;
+      for (auto& curr : module->functions) {
+        all.push_back(curr.get());
+      }
+      validateFunctions(module, all);
+    }
+    walkTable(&module->table);
+    walkMemory(&module->memory);
+  }
+
+  void validateFunctions(Module* module, const std::vector<Function*>& list) {
+    size_t num = getNumParallelWorkers(list.size());
+    if (num == 1) {
+      for (auto* func : list) {
+        walkFunction(func);
+      }
+      return;
+    }
+    struct Worker {
+      WasmValidator validator;
+      std::stringstream buffer;
+    };
+    std::vector<Worker> workers(num);
+    for (auto& worker : workers) {
+      worker.validator.validateWeb = validateWeb;
+      worker.validator.validateGlobally = validateGlobally;
+      worker.validator.stream = &worker.buffer;
+      worker.validator.setModule(module);
+    }
+    std::vector<std::string> errors(list.size());
+    std::atomic<bool> allValid(true);
+    parallelFor(list.size(), [&](size_t worker, size_t index) {
+      auto& validator = workers[worker].validator;
+      auto& buffer = workers[worker].buffer;
+      validator.walkFunction(list[index]);
+      if (!validator.valid) {
+        errors[index] = buffer.str();
+        buffer.str("");
+        validator.valid = true;
+        allValid = false;
+      }
+    });
+    if (!allValid) {
+      valid = false;
+      for (auto& error : errors) {
+        *stream << error;
+      }
+    }
+  }
+
   // visitors
 
   static void visitPreBlock(WasmValidator* self, Expression** currp) {
@@ -124,7 +223,7 @@ public:
     if (curr->list.size() > 1) {
       for (Index i = 0; i < curr->list.size() - 1; i++) {
         if (!shouldBeTrue(!isConcreteWasmType(curr->list[i]->type), curr, "non-final block elements returning a value must be drop()ed (binaryen's autodrop option might help you)")) {
-          std::cerr << "(on index " << i << ":\n" << curr->list[i] << "\n), type: " << curr->list[i]->type << "\n";
+          *stream << "(on index " << i << ":\n" << curr->list[i] << "\n), type: " << curr->list[i]->type << "\n";
         }
       }
     }
@@ -229,7 +328,7 @@ public:
     if (!shouldBeTrue(curr->operands.size() == target->params.size(), curr, "call param number must match")) return;
     for (size_t i = 0; i < curr->operands.size(); i++) {
       if (!shouldBeEqualOrFirstIsUnreachable(curr->operands[i]->type, target->params[i], curr, "call param types must match")) {
-        std::cerr << "(on argument " << i << ")\n";
+        *stream << "(on argument " << i << ")\n";
       }
     }
   }
@@ -242,7 +341,7 @@ public:
     if (!shouldBeTrue(curr->operands.size() == type->params.size(), curr, "call param number must match")) return;
     for (size_t i = 0; i < curr->operands.size(); i++) {
       if (!shouldBeEqualOrFirstIsUnreachable(curr->operands[i]->type, type->params[i], curr, "call param types must match")) {
-        std::cerr << "(on argument " << i << ")\n";
+        *stream << "(on argument " << i << ")\n";
       }
     }
   }
@@ -254,7 +353,7 @@ public:
     if (!shouldBeTrue(curr->operands.size() == type->params.size(), curr, "call param number must match")) return;
     for (size_t i = 0; i < curr->operands.size(); i++) {
       if (!shouldBeEqualOrFirstIsUnreachable(curr->operands[i]->type, type->params[i], curr, "call param types must match")) {
-        std::cerr << "(on argument " << i << ")\n";
+        *stream << "(on argument " << i << ")\n";
       }
     }
   }
@@ -427,7 +526,7 @@ public:
     shouldBeTrue(curr->init != nullptr, curr->name, "global init must be non-null");
     shouldBeTrue(curr->init->is<Const>() || curr->init->is<GetGlobal>(), curr->name, "global init must be valid");
     if (!shouldBeEqual(curr->type, curr->init->type, curr->init, "global init must have correct type")) {
-      std::cerr << "(on global " << curr->name << '\n';
+      *stream << "(on global " << curr->name << '\n';
     }
   }
 
@@ -521,18 +620,18 @@ private:
   // helpers
 
   std::ostream& fail() {
-    Colors::red(std::cerr);
+    Colors::red(*stream);
     if (getFunction()) {
-      std::cerr << "[wasm-validator error in function ";
-      Colors::green(std::cerr);
-      std::cerr << getFunction()->name;
-      Colors::red(std::cerr);
-      std::cerr << "] ";
+      *stream << "[wasm-validator error in function ";
+      Colors::green(*stream);
+      *stream << getFunction()->name;
+      Colors::red(*stream);
+      *stream << "] ";
     } else {
-      std::cerr << "[wasm-validator error in module] ";
+      *stream << "[wasm-validator error in module] ";
     }
-    Colors::normal(std::cerr);
-    return std::cerr;
+    Colors::normal(*stream);
+    return *stream;
   }
 
   template<typename T>
@@ -558,7 +657,7 @@ private:
   bool shouldBeEqual(S left, S right, T curr, const char* text) {
     if (left != right) {
       fail() << "" << left << " != " << right << ": " << text << ", on \n";
-      WasmPrinter::printExpression(curr, std::cerr, false, true) << std::endl;
+      WasmPrinter::printExpression(curr, *stream, false, true) << std::endl;
       valid = false;
       return false;
     }
@@ -578,7 +677,7 @@ private:
   bool shouldBeEqualOrFirstIsUnreachable(S left, S right, T curr, const char* text) {
     if (left != unreachable && left != right) {
       fail() << "" << left << " != " << right << ": " << text << ", on \n";
-      WasmPrinter::printExpression(curr, std::cerr, false, true) << std::endl;
+      WasmPrinter::printExpression(curr, *stream, false, true) << std::endl;
       valid = false;
       return false;
     }
@@ -624,6 +723,168 @@ private:
   }
 };
 
+//
+// Validates a module again each time it is changed, for example after each
+// pass in a pass runner, validating only the functions that changed since
+// they were last found valid. Changes are found by comparing fingerprints of
+// the functions, which take a single quick walk to compute, and are done in
+// parallel. When validating globally, functions also depend on the
+// signatures of the other functions, on the imports and on the function
+// types, and if any of those changed then all the functions are validated.
+// The module-level checks are cheap, and are always done.
+//
+
+struct IncrementalValidator {
+  bool validateWeb;
+  bool validateGlobally;
+
+  // how many functions the last call to validate() validated
+  size_t numValidated = 0;
+
+  IncrementalValidator(bool validateWeb = false, bool validateGlobally = true) : validateWeb(validateWeb), validateGlobally(validateGlobally) {}
+
+  bool validate(Module& module) {
+    uint64_t globalDigest = validateGlobally ? fingerprintGlobals(module) : 0;
+    if (globalDigest != lastGlobalDigest) {
+      validDigests.clear();
+    }
+    auto digests = fingerprintFunctions(module);
+    std::vector<Function*> changed;
+    for (size_t i = 0; i < module.functions.size(); i++) {
+      auto iter = validDigests.find(module.functions[i].get());
+      if (iter == validDigests.end() || iter->second != digests[i]) {
+        changed.push_back(module.functions[i].get());
+      }
+    }
+    numValidated = changed.size();
+    if (!WasmValidator().validate(module, changed, validateWeb, validateGlobally)) {
+      return false;
+    }
+    // this also forgets functions that were removed
+    validDigests.clear();
+    for (size_t i = 0; i < module.functions.size(); i++) {
+      validDigests[module.functions[i].get()] = digests[i];
+    }
+    lastGlobalDigest = globalDigest;
+    return true;
+  }
+
+private:
+  std::unordered_map<Function*, uint64_t> validDigests;
+  uint64_t lastGlobalDigest = 0;
+
+  // Mixes in the nodes of a function in post-order, with their types and
+  // the fields that can be changed in place and that validation depends
+  // on. The nodes' addresses are mixed in too, so moving, replacing or
+  // removing nodes changes the result.
+  struct Fingerprinter : public PostWalker<Fingerprinter, UnifiedExpressionVisitor<Fingerprinter>> {
+    uint64_t digest = 0;
+
+    void mix(uint64_t value) {
+      digest = (digest ^ value) * 0x9e3779b97f4a7c15ULL;
+      digest ^= digest >> 29;
+    }
+    void mix(Name name) {
+      mix(uint64_t(name.str));
+    }
+    void mix(const std::vector<WasmType>& types) {
+      mix(types.size());
+      for (auto type : types) {
+        mix(type);
+      }
+    }
+
+    void visitExpression(Expression* curr) {
+      mix(uint64_t(curr));
+      mix((uint64_t(curr->_id) << 32) | curr->type);
+      switch (curr->_id) {
+        case Expression::Id::BlockId: mix(curr->cast<Block>()->name); mix(curr->cast<Block>()->list.size()); break;
+        case Expression::Id::IfId: mix(curr->cast<If>()->ifFalse != nullptr); break;
+        case Expression::Id::LoopId: mix(curr->cast<Loop>()->name); break;
+        case Expression::Id::BreakId: {
+          auto* br = curr->cast<Break>();
+          mix(br->name);
+          mix((br->value != nullptr) | (br->condition != nullptr) << 1);
+          break;
+        }
+        case Expression::Id::SwitchId: {
+          auto* sw = curr->cast<Switch>();
+          mix(sw->targets.size());
+          for (auto target : sw->targets) {
+            mix(target);
+          }
+          mix(sw->default_);
+          mix(sw->value != nullptr);
+          break;
+        }
+        case Expression::Id::CallId: mix(curr->cast<Call>()->target); mix(curr->cast<Call>()->operands.size()); break;
+        case Expression::Id::CallImportId: mix(curr->cast<CallImport>()->target); mix(curr->cast<CallImport>()->operands.size()); break;
+        case Expression::Id::CallIndirectId: mix(curr->cast<CallIndirect>()->fullType); mix(curr->cast<CallIndirect>()->operands.size()); break;
+        case Expression::Id::GetLocalId: mix(curr->cast<GetLocal>()->index); break;
+        case Expression::Id::SetLocalId: mix(curr->cast<SetLocal>()->index); break;
+        case Expression::Id::GetGlobalId: mix(curr->cast<GetGlobal>()->name); break;
+        case Expression::Id::SetGlobalId: mix(curr->cast<SetGlobal>()->name); break;
+        case Expression::Id::LoadId: {
+          auto* load = curr->cast<Load>();
+          mix(load->bytes | load->signed_ << 8 | uint64_t(load->align) << 16 | uint64_t(load->offset) << 32);
+          break;
+        }
+        case Expression::Id::StoreId: {
+          auto* store = curr->cast<Store>();
+          mix(store->bytes | store->valueType << 8 | uint64_t(store->align) << 16 | uint64_t(store->offset) << 32);
+          break;
+        }
+        case Expression::Id::ConstId: mix(curr->cast<Const>()->value.type); break;
+        case Expression::Id::UnaryId: mix(curr->cast<Unary>()->op); break;
+        case Expression::Id::BinaryId: mix(curr->cast<Binary>()->op); break;
+        case Expression::Id::ReturnId: mix(curr->cast<Return>()->value != nullptr); break;
+        case Expression::Id::HostId: mix(curr->cast<Host>()->op); mix(curr->cast<Host>()->operands.size()); break;
+        default: {}
+      }
+    }
+
+    static uint64_t fingerprint(Function* func) {
+      Fingerprinter fingerprinter;
+      fingerprinter.mix(func->type);
+      fingerprinter.mix(func->params);
+      fingerprinter.mix(func->vars);
+      fingerprinter.mix(func->result);
+      fingerprinter.walk(func->body);
+      return fingerprinter.digest;
+    }
+  };
+
+  // what the validity of functions depends on, outside of themselves
+  static uint64_t fingerprintGlobals(Module& module) {
+    Fingerprinter fingerprinter;
+    for (auto& func : module.functions) {
+      fingerprinter.mix(func->name);
+      fingerprinter.mix(func->params);
+      fingerprinter.mix(func->result);
+    }
+    for (auto& type : module.functionTypes) {
+      fingerprinter.mix(type->name);
+      fingerprinter.mix(type->params);
+      fingerprinter.mix(type->result);
+    }
+    for (auto& import : module.imports) {
+      fingerprinter.mix(import->name);
+      fingerprinter.mix(uint64_t(import->kind));
+      fingerprinter.mix(import->functionType);
+    }
+    return fingerprinter.digest;
+  }
+
+  static std::vector<uint64_t> fingerprintFunctions(Module& module) {
+    auto& functions = module.functions;
+    std::vector<uint64_t> digests(functions.size());
+    parallelFor(functions.size(), [&](size_t worker, size_t index) {
+      digests[index] = Fingerprinter::fingerprint(functions[index].get());
+    });
+    return digests;
+  }
+};
+
 } // namespace wasm
 
 #endif // wasm_wasm_validator_h
@@ -47,6 +47,7 @@
 #include <cassert>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "literal.h"
@@ -656,11 +657,14 @@ public:
 
 private:
   // TODO: add a build option where Names are just indices, and then these methods are not needed
-  std::map<Name, FunctionType*> functionTypesMap;
-  std::map<Name, Import*> importsMap;
-  std::map<Name, Export*> exportsMap; // exports map is by the *exported* name, which is unique
-  std::map<Name, Function*> functionsMap;
-  std::map<Name, Global*> globalsMap;
+  // Names are interned, so these hash them by their pointers. They are only
+  // used for lookups; iteration is done on the vectors above, whose order
+  // is deterministic.
+  std::unordered_map<Name, FunctionType*> functionTypesMap;
+  std::unordered_map<Name, Import*> importsMap;
+  std::unordered_map<Name, Export*> exportsMap; // exports map is by the *exported* name, which is unique
+  std::unordered_map<Name, Function*> functionsMap;
+  std::unordered_map<Name, Global*> globalsMap;
 
 public:
   Module() {};
@@ -164,8 +164,8 @@ std::ostream& operator<<(std::ostream& o, Literal literal) {
   prepareMinorColor(o) << printWasmType(literal.type) << ".const ";
   switch (literal.type) {
     case none: o << "?"; break;
-    case WasmType::i32: o << literal.i32; break;
-    case WasmType::i64: o << literal.i64; break;
+    case WasmType::i32: printSigned(o, literal.i32); break;
+    case WasmType::i64: printSigned(o, literal.i64); break;
     case WasmType::f32: literal.printFloat(o, literal.getf32()); break;
     case WasmType::f64: literal.printDouble(o, literal.getf64()); break;
     default: WASM_UNREACHABLE();
@@ -17,7 +17,9 @@
 #include "wasm-binary.h"
 
 #include <fstream>
+#include <mutex>
 #include "support/bits.h"
+#include "support/threads.h"
 
 namespace wasm {
 
@@ -49,6 +51,7 @@ void WasmBinaryWriter::write() {
   if (symbolMap.size() > 0) writeSymbolMap();
 
   finishUp();
+  flush();
 }
 
 void WasmBinaryWriter::writeHeader() {
@@ -64,6 +67,29 @@ int32_t WasmBinaryWriter::writeU32LEBPlaceholder() {
   return ret;
 }
 
+void WasmBinaryWriter::writeSizeAt(size_t pos, uint32_t size) {
+  if (!minimalSizes) {
+    o.writeAt(pos, U32LEB(size));
+    return;
+  }
+  if (debug) std::cerr << "backpatchMinimalU32LEB: " << size << " (at " << pos << ")" << std::endl;
+  U32LEB leb(size);
+  auto bytes = leb.size();
+  leb.writeAt(&o, pos);
+  o.erase(o.begin() + pos + bytes, o.begin() + pos + 5);
+}
+
+void WasmBinaryWriter::writeSize(uint32_t size) {
+  writeSizeAt(writeU32LEBPlaceholder(), size);
+}
+
+void WasmBinaryWriter::flush() {
+  if (!streamTo) return;
+  if (debug) std::cerr << "flush " << o.size() << " bytes" << std::endl;
+  streamTo->write((const char*)o.data(), o.size());
+  o.clear();
+}
+
 void WasmBinaryWriter::writeResizableLimits(Address initial, Address maximum, bool hasMaximum) {
   uint32_t flags = hasMaximum ? 1 : 0;
   o << U32LEB(flags);
@@ -80,7 +106,8 @@ int32_t WasmBinaryWriter::startSection(BinaryConsts::Section code) {
 
 void WasmBinaryWriter::finishSection(int32_t start) {
   int32_t size = o.size() - start - 5; // section size does not include the 5 bytes of the size field itself
-  o.writeAt(start, U32LEB(size));
+  writeSizeAt(start, size);
+  flush();
 }
 
 int32_t WasmBinaryWriter::startSubsection(BinaryConsts::UserSections::Subsection code) {
@@ -90,7 +117,7 @@ int32_t WasmBinaryWriter::startSubsection(BinaryConsts::UserSections::Subsection
 
 void WasmBinaryWriter::finishSubsection(int32_t start) {
   int32_t size = o.size() - start - 5; // section size does not include the 5 bytes of the size field itself
-  o.writeAt(start, U32LEB(size));
+  writeSizeAt(start, size);
 }
 
 void WasmBinaryWriter::writeStart() {
@@ -228,39 +255,126 @@ void WasmBinaryWriter::writeExpression(Expression* curr) {
 void WasmBinaryWriter::writeFunctions() {
   if (wasm->functions.size() == 0) return;
   if (debug) std::cerr << "== writeFunctions" << std::endl;
-  auto start = startSection(BinaryConsts::Section::Code);
   size_t total = wasm->functions.size();
+  bool parallel = !debug && total > 1 && ThreadPool::get()->size() > 1;
+  if (streamTo) {
+    // the section size comes first, and we don't want to hold the whole
+    // section in memory to find it, so size each body on its own (by writing
+    // it and then discarding it), and then write them again for real
+    std::vector<uint32_t> sizes;
+    if (parallel) {
+      encodeFunctionBodies(nullptr, sizes);
+    } else {
+      for (size_t i = 0; i < total; i++) {
+        auto before = o.size();
+        writeFunctionBody(wasm->functions[i].get());
+        sizes.push_back(o.size() - before);
+        o.resize(before);
+      }
+    }
+    uint64_t sectionSize = U32LEB(total).size();
+    for (auto size : sizes) {
+      sectionSize += (minimalSizes ? U32LEB(size).size() : 5) + size;
+    }
+    assert(sectionSize <= std::numeric_limits<uint32_t>::max());
+    o << U32LEB(BinaryConsts::Section::Code);
+    writeSize(sectionSize);
+    o << U32LEB(total);
+    for (size_t i = 0; i < total; i++) {
+      writeSize(sizes[i]);
+      writeFunctionBody(wasm->functions[i].get());
+      flush();
+    }
+    return;
+  }
+  auto start = startSection(BinaryConsts::Section::Code);
   o << U32LEB(total);
+  if (parallel) {
+    std::vector<std::vector<uint8_t>> bodies;
+    std::vector<uint32_t> sizes;
+    encodeFunctionBodies(&bodies, sizes);
+    for (size_t i = 0; i < total; i++) {
+      writeSize(sizes[i]);
+      o.insert(o.end(), bodies[i].begin(), bodies[i].end());
+      std::vector<uint8_t>().swap(bodies[i]); // free it as we go
+    }
+    finishSection(start);
+    return;
+  }
   for (size_t i = 0; i < total; i++) {
     if (debug) std::cerr << "write one at" << o.size() << std::endl;
     size_t sizePos = writeU32LEBPlaceholder();
     size_t start = o.size();
-    Function* function = wasm->functions[i].get();
-    mappedLocals.clear();
-    numLocalsByType.clear();
-    if (debug) std::cerr << "writing" << function->name << std::endl;
-    mapLocals(function);
-    o << U32LEB(
-        (numLocalsByType[i32] ? 1 : 0) +
-        (numLocalsByType[i64] ? 1 : 0) +
-        (numLocalsByType[f32] ? 1 : 0) +
-        (numLocalsByType[f64] ? 1 : 0)
-                );
-    if (numLocalsByType[i32]) o << U32LEB(numLocalsByType[i32]) << binaryWasmType(i32);
-    if (numLocalsByType[i64]) o << U32LEB(numLocalsByType[i64]) << binaryWasmType(i64);
-    if (numLocalsByType[f32]) o << U32LEB(numLocalsByType[f32]) << binaryWasmType(f32);
-    if (numLocalsByType[f64]) o << U32LEB(numLocalsByType[f64]) << binaryWasmType(f64);
-
-    writeExpression(function->body);
-    o << int8_t(BinaryConsts::End);
+    writeFunctionBody(wasm->functions[i].get());
     size_t size = o.size() - start;
     assert(size <= std::numeric_limits<uint32_t>::max());
     if (debug) std::cerr << "body size: " << size << ", writing at " << sizePos << ", next starts at " << o.size() << std::endl;
-    o.writeAt(sizePos, U32LEB(size));
+    writeSizeAt(sizePos, size);
   }
   finishSection(start);
 }
 
+void WasmBinaryWriter::encodeFunctionBodies(std::vector<std::vector<uint8_t>>* bodies, std::vector<uint32_t>& sizes) {
+  size_t total = wasm->functions.size();
+  size_t num = ThreadPool::get()->size();
+  // the index maps are created lazily, create them now so the workers copy them
+  getFunctionIndex(wasm->functions[0]->name);
+  if (wasm->globals.size() > 0) getGlobalIndex(wasm->globals[0]->name);
+  std::vector<size_t> costs;
+  for (auto& func : wasm->functions) {
+    costs.push_back(Measurer::measure(func->body));
+  }
+  WorkStealingQueue queue(num);
+  queue.addByCost(costs);
+  if (bodies) bodies->resize(total);
+  sizes.resize(total);
+  std::vector<std::unique_ptr<BufferWithRandomAccess>> buffers;
+  std::vector<std::unique_ptr<WasmBinaryWriter>> writers;
+  for (size_t i = 0; i < num; i++) {
+    buffers.emplace_back(new BufferWithRandomAccess(false));
+    writers.emplace_back(new WasmBinaryWriter(*this, *buffers[i]));
+  }
+  std::vector<std::function<ThreadWorkState ()>> doWorkers;
+  for (size_t i = 0; i < num; i++) {
+    doWorkers.push_back([&, i]() {
+      size_t index;
+      if (!queue.pop(i, index)) {
+        return ThreadWorkState::Finished;
+      }
+      auto& buffer = *buffers[i];
+      writers[i]->writeFunctionBody(wasm->functions[index].get());
+      assert(buffer.size() <= std::numeric_limits<uint32_t>::max());
+      sizes[index] = buffer.size();
+      if (bodies) {
+        (*bodies)[index].swap(buffer);
+      }
+      buffer.clear();
+      return ThreadWorkState::More;
+    });
+  }
+  ThreadPool::get()->work(doWorkers);
+}
+
+void WasmBinaryWriter::writeFunctionBody(Function* function) {
+  mappedLocals.clear();
+  numLocalsByType.clear();
+  if (debug) std::cerr << "writing" << function->name << std::endl;
+  mapLocals(function);
+  o << U32LEB(
+      (numLocalsByType[i32] ? 1 : 0) +
+      (numLocalsByType[i64] ? 1 : 0) +
+      (numLocalsByType[f32] ? 1 : 0) +
+      (numLocalsByType[f64] ? 1 : 0)
+              );
+  if (numLocalsByType[i32]) o << U32LEB(numLocalsByType[i32]) << binaryWasmType(i32);
+  if (numLocalsByType[i64]) o << U32LEB(numLocalsByType[i64]) << binaryWasmType(i64);
+  if (numLocalsByType[f32]) o << U32LEB(numLocalsByType[f32]) << binaryWasmType(f32);
+  if (numLocalsByType[f64]) o << U32LEB(numLocalsByType[f64]) << binaryWasmType(f64);
+
+  writeExpression(function->body);
+  o << int8_t(BinaryConsts::End);
+}
+
 void WasmBinaryWriter::writeGlobals() {
   if (wasm->globals.size() == 0) return;
   if (debug) std::cerr << "== writeglobals" << std::endl;
@@ -450,6 +564,7 @@ void WasmBinaryWriter::writeInlineBuffer(const char* data, size_t size) {
 
 void WasmBinaryWriter::emitBuffer(const char* data, size_t size) {
   assert(size > 0);
+  assert(!streamTo); // the pointers we backpatch are offsets into the whole binary
   buffersToWrite.emplace_back(data, size, o.size());
   o << uint32_t(0); // placeholder, we'll fill in the pointer to the buffer later when we have it
 }
@@ -941,7 +1056,7 @@ void WasmBinaryBuilder::read() {
   while (more()) {
     uint32_t sectionCode = getU32LEB();
     uint32_t payloadLen = getU32LEB();
-    if (pos + payloadLen > input.size()) throw ParseException("Section extends beyond end of input");
+    if (pos + payloadLen > inputSize) throw ParseException("Section extends beyond end of input");
 
     auto oldPos = pos;
 
@@ -1042,12 +1157,23 @@ Literal WasmBinaryBuilder::getFloat64Literal() {
   return ret;
 }
 
+template<typename T, typename MiniT>
+void WasmBinaryBuilder::readLEB(LEB<T, MiniT>& leb) {
+  if (debug) {
+    // go through getInt8, which logs each byte
+    leb.read([&]() {
+      return MiniT(getInt8());
+    });
+    return;
+  }
+  auto* start = (const uint8_t*)input;
+  pos = leb.read(start + pos, start + inputSize) - start;
+}
+
 uint32_t WasmBinaryBuilder::getU32LEB() {
   if (debug) std::cerr << "<==" << std::endl;
   U32LEB ret;
-  ret.read([&]() {
-      return getInt8();
-    });
+  readLEB(ret);
   if (debug) std::cerr << "getU32LEB: " << ret.value << " ==>" << std::endl;
   return ret.value;
 }
@@ -1055,9 +1181,7 @@ uint32_t WasmBinaryBuilder::getU32LEB() {
 uint64_t WasmBinaryBuilder::getU64LEB() {
   if (debug) std::cerr << "<==" << std::endl;
   U64LEB ret;
-  ret.read([&]() {
-      return getInt8();
-    });
+  readLEB(ret);
   if (debug) std::cerr << "getU64LEB: " << ret.value << " ==>" << std::endl;
   return ret.value;
 }
@@ -1065,9 +1189,7 @@ uint64_t WasmBinaryBuilder::getU64LEB() {
 int32_t WasmBinaryBuilder::getS32LEB() {
   if (debug) std::cerr << "<==" << std::endl;
   S32LEB ret;
-  ret.read([&]() {
-      return (int8_t)getInt8();
-    });
+  readLEB(ret);
   if (debug) std::cerr << "getS32LEB: " << ret.value << " ==>" << std::endl;
   return ret.value;
 }
@@ -1075,9 +1197,7 @@ int32_t WasmBinaryBuilder::getS32LEB() {
 int64_t WasmBinaryBuilder::getS64LEB() {
   if (debug) std::cerr << "<==" << std::endl;
   S64LEB ret;
-  ret.read([&]() {
-      return (int8_t)getInt8();
-    });
+  readLEB(ret);
   if (debug) std::cerr << "getS64LEB: " << ret.value << " ==>" << std::endl;
   return ret.value;
 }
@@ -1098,7 +1218,7 @@ WasmType WasmBinaryBuilder::getWasmType() {
 Name WasmBinaryBuilder::getString() {
   if (debug) std::cerr << "<==" << std::endl;
   size_t offset = getInt32();
-  Name ret = cashew::IString((&input[0]) + offset, false);
+  Name ret = cashew::IString(input + offset, false);
   if (debug) std::cerr << "getString: " << ret << " ==>" << std::endl;
   return ret;
 }
@@ -1270,64 +1390,134 @@ void WasmBinaryBuilder::readFunctions() {
   if (debug) std::cerr << "== readFunctions" << std::endl;
   size_t total = getU32LEB();
   assert(total == functionTypes.size());
+  assert(functions.empty());
+  // find where each body is first, then decode them
+  std::vector<size_t> starts, ends;
   for (size_t i = 0; i < total; i++) {
     if (debug) std::cerr << "read one at " << pos << std::endl;
     size_t size = getU32LEB();
     assert(size > 0);
-    endOfFunction = pos + size;
-    auto type = functionTypes[i];
-    if (debug) std::cerr << "reading " << i << std::endl;
-    size_t nextVar = 0;
-    auto addVar = [&]() {
-      Name name = cashew::IString(("var$" + std::to_string(nextVar++)).c_str(), false);
-      return name;
-    };
-    std::vector<NameType> params, vars;
-    for (size_t j = 0; j < type->params.size(); j++) {
-      params.emplace_back(addVar(), type->params[j]);
+    if (pos + size > inputSize) throw ParseException("Function body extends beyond end of input");
+    starts.push_back(pos);
+    pos += size;
+    ends.push_back(pos);
+  }
+  auto endOfSection = pos;
+  if (!debug && total > 1 && ThreadPool::get()->size() > 1) {
+    readFunctionBodiesInParallel(starts, ends);
+  } else {
+    for (size_t i = 0; i < total; i++) {
+      functions.push_back(readFunctionBody(i, starts[i], ends[i]));
     }
-    size_t numLocalTypes = getU32LEB();
-    for (size_t t = 0; t < numLocalTypes; t++) {
-      auto num = getU32LEB();
-      auto type = getWasmType();
-      while (num > 0) {
-        vars.emplace_back(addVar(), type);
-        num--;
+  }
+  pos = endOfSection;
+  if (debug) std::cerr << " end function bodies" << std::endl;
+}
+
+void WasmBinaryBuilder::readFunctionBodiesInParallel(std::vector<size_t>& starts, std::vector<size_t>& ends) {
+  size_t total = starts.size();
+  size_t num = ThreadPool::get()->size();
+  // start with the largest bodies, so that the workers finish at about the same time
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < total; i++) {
+    sizes.push_back(ends[i] - starts[i]);
+  }
+  WorkStealingQueue queue(num);
+  queue.addByCost(sizes);
+  functions.resize(total);
+  std::vector<std::unique_ptr<WasmBinaryBuilder>> decoders;
+  for (size_t i = 0; i < num; i++) {
+    decoders.emplace_back(new WasmBinaryBuilder(*this));
+  }
+  // on an error, report the first one in the module, like a serial read would
+  std::mutex errorMutex;
+  Index errorIndex = -1;
+  ParseException error;
+  std::vector<std::function<ThreadWorkState ()>> doWorkers;
+  for (size_t i = 0; i < num; i++) {
+    doWorkers.push_back([&, i]() {
+      size_t index;
+      if (!queue.pop(i, index)) {
+        return ThreadWorkState::Finished;
       }
-    }
-    auto func = Builder(wasm).makeFunction(
-        Name::fromInt(i),
-        std::move(params),
-        type->result,
-        std::move(vars)
-                                           );
-    func->type = type->name;
-    currFunction = func;
-    {
-      // process the function body
-      if (debug) std::cerr << "processing function: " << i << std::endl;
-      nextLabel = 0;
-      breaksToReturn = false;
-      // process body
-      assert(breakStack.empty());
-      breakStack.emplace_back(RETURN_BREAK, func->result != none); // the break target for the function scope
-      assert(expressionStack.empty());
-      assert(depth == 0);
-      func->body = getMaybeBlock(func->result);
-      assert(depth == 0);
-      assert(breakStack.size() == 1);
-      breakStack.pop_back();
-      assert(expressionStack.empty());
-      assert(pos == endOfFunction);
-      if (breaksToReturn) {
-        // we broke to return, so we need an outer block to break to
-        func->body = Builder(wasm).blockifyWithName(func->body, RETURN_BREAK);
+      try {
+        functions[index] = decoders[i]->readFunctionBody(index, starts[index], ends[index]);
+      } catch (ParseException& p) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (index < errorIndex) {
+          errorIndex = index;
+          error = p;
+        }
+        // the decoding state was left mid-function, start over with a fresh one
+        decoders[i].reset(new WasmBinaryBuilder(*this));
       }
+      return ThreadWorkState::More;
+    });
+  }
+  ThreadPool::get()->work(doWorkers);
+  if (errorIndex != Index(-1)) throw error;
+  for (auto& decoder : decoders) {
+    for (auto& iter : decoder->functionCalls) {
+      auto& calls = functionCalls[iter.first];
+      calls.insert(calls.end(), iter.second.begin(), iter.second.end());
     }
-    currFunction = nullptr;
-    functions.push_back(func);
   }
-  if (debug) std::cerr << " end function bodies" << std::endl;
+}
+
+Function* WasmBinaryBuilder::readFunctionBody(Index i, size_t start, size_t end) {
+  pos = start;
+  endOfFunction = end;
+  auto type = functionTypes[i];
+  if (debug) std::cerr << "reading " << i << std::endl;
+  size_t nextVar = 0;
+  auto addVar = [&]() {
+    Name name = cashew::IString(("var$" + std::to_string(nextVar++)).c_str(), false);
+    return name;
+  };
+  std::vector<NameType> params, vars;
+  for (size_t j = 0; j < type->params.size(); j++) {
+    params.emplace_back(addVar(), type->params[j]);
+  }
+  size_t numLocalTypes = getU32LEB();
+  for (size_t t = 0; t < numLocalTypes; t++) {
+    auto num = getU32LEB();
+    auto type = getWasmType();
+    while (num > 0) {
+      vars.emplace_back(addVar(), type);
+      num--;
+    }
+  }
+  auto func = Builder(wasm).makeFunction(
+      Name::fromInt(i),
+      std::move(params),
+      type->result,
+      std::move(vars)
+                                         );
+  func->type = type->name;
+  currFunction = func;
+  {
+    // process the function body
+    if (debug) std::cerr << "processing function: " << i << std::endl;
+    nextLabel = 0;
+    breaksToReturn = false;
+    // process body
+    assert(breakStack.empty());
+    breakStack.emplace_back(RETURN_BREAK, func->result != none); // the break target for the function scope
+    assert(expressionStack.empty());
+    assert(depth == 0);
+    func->body = getMaybeBlock(func->result);
+    assert(depth == 0);
+    assert(breakStack.size() == 1);
+    breakStack.pop_back();
+    assert(expressionStack.empty());
+    assert(pos == endOfFunction);
+    if (breaksToReturn) {
+      // we broke to return, so we need an outer block to break to
+      func->body = Builder(wasm).blockifyWithName(func->body, RETURN_BREAK);
+    }
+  }
+  currFunction = nullptr;
+  return func;
 }
 
 void WasmBinaryBuilder::readExports() {
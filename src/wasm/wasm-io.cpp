@@ -33,16 +33,16 @@ namespace wasm {
 
 void ModuleReader::readText(std::string filename, Module& wasm) {
   if (debug) std::cerr << "reading text from " << filename << "\n";
-  auto input(read_file<std::string>(filename, Flags::Text, debug ? Flags::Debug : Flags::Release));
-  SExpressionParser parser(const_cast<char*>(input.c_str()));
+  MappedFile input(filename, Flags::Text, debug ? Flags::Debug : Flags::Release);
+  SExpressionParser parser(input.data());
   Element& root = *parser.root;
   SExpressionWasmBuilder builder(wasm, *root[0]);
 }
 
 void ModuleReader::readBinary(std::string filename, Module& wasm) {
   if (debug) std::cerr << "reading binary from " << filename << "\n";
-  auto input(read_file<std::vector<char>>(filename, Flags::Binary, debug ? Flags::Debug : Flags::Release));
-  WasmBinaryBuilder parser(wasm, input, debug);
+  MappedFile input(filename, Flags::Binary, debug ? Flags::Debug : Flags::Release);
+  WasmBinaryBuilder parser(wasm, input.data(), input.size(), debug);
   parser.read();
 }
 
@@ -73,7 +73,14 @@ void ModuleWriter::writeBinary(Module& wasm, std::string filename) {
   BufferWithRandomAccess buffer(debug);
   WasmBinaryWriter writer(&wasm, buffer, debug);
   writer.setDebugInfo(debugInfo);
+  writer.setMinimalSizes(minimalSizes);
   if (symbolMap.size() > 0) writer.setSymbolMap(symbolMap);
+  if (streaming) {
+    Output output(filename, Flags::Binary, debug ? Flags::Debug : Flags::Release);
+    writer.setOutputStream(&output.getStream());
+    writer.write();
+    return;
+  }
   writer.write();
   Output output(filename, Flags::Binary, debug ? Flags::Debug : Flags::Release);
   buffer.writeTo(output);
@@ -26,6 +26,7 @@
 #include "shared-constants.h"
 #include "wasm-binary.h"
 #include "wasm-builder.h"
+#include "support/threads.h"
 
 #define abort_on(str) { throw ParseException(std::string("abort_on ") + str); }
 #define element_assert(condition) assert((condition) ? true : (std::cerr << "on: " << *this << '\n' && 0));
@@ -39,6 +40,16 @@ int unhex(char c) {
   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
   abort();
 }
+
+// the characters isspace() accepts in the C locale, without its overhead
+inline bool isSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// characters that end a string that is not quoted
+inline bool endsString(char c) {
+  return c == 0 || isSpace(c) || c == '(' || c == ')' || c == ';';
+}
 }
 
 namespace wasm {
@@ -54,22 +65,41 @@ Element* Element::operator[](unsigned i) {
 
 IString Element::str() {
   element_assert(!isList_);
+  if (!str_.is()) {
+    // the text is not null-terminated, so intern a copy of it
+    str_ = IString(text().c_str(), false);
+  }
   return str_;
 }
 
 const char* Element::c_str() {
+  return str().str;
+}
+
+std::string Element::text() {
   element_assert(!isList_);
-  return str_.str;
+  return std::string(text_, size_);
 }
 
 Element* Element::setString(IString str__, bool dollared__, bool quoted__) {
   isList_ = false;
+  text_ = str__.str;
+  size_ = strlen(str__.str);
   str_ = str__;
   dollared_ = dollared__;
   quoted_ = quoted__;
   return this;
 }
 
+Element* Element::setString(const char* text__, size_t size__, bool dollared__, bool quoted__) {
+  isList_ = false;
+  text_ = text__;
+  size_ = size__;
+  dollared_ = dollared__;
+  quoted_ = quoted__;
+  return this;
+}
+
 Element* Element::setMetadata(size_t line_, size_t col_) {
   line = line_;
   col = col_;
@@ -82,7 +112,7 @@ std::ostream& operator<<(std::ostream& o, Element& e) {
     for (auto item : e.list_) o << ' ' << *item;
     o << " )";
   } else {
-    o << e.str_.str;
+    o.write(e.text_, e.size_);
   }
   return o;
 }
@@ -92,7 +122,7 @@ void Element::dump() {
 }
 
 
-SExpressionParser::SExpressionParser(char* input) : input(input) {
+SExpressionParser::SExpressionParser(const char* input) : input(input) {
   root = nullptr;
   line = 1;
   lineStart = input;
@@ -102,7 +132,20 @@ SExpressionParser::SExpressionParser(char* input) : input(input) {
 }
 
 Element* SExpressionParser::parse() {
-  std::vector<Element *> stack;
+  // The lists that are open, and the elements that are in them so far,
+  // which are all kept in one stack, so that when a list ends, its array
+  // can be allocated at the right size instead of growing as it is filled.
+  std::vector<Element*> stack;
+  std::vector<Element*> items;
+  std::vector<size_t> starts; // where the items of each open list start
+  auto finishList = [&](Element* curr, size_t start) {
+    auto& list = curr->list();
+    list.reserve(items.size() - start);
+    for (size_t i = start; i < items.size(); i++) {
+      list.push_back(items[i]);
+    }
+    items.resize(start);
+  };
   Element *curr = allocator.alloc<Element>();
   while (1) {
     skipWhitespace();
@@ -110,25 +153,28 @@ Element* SExpressionParser::parse() {
     if (input[0] == '(') {
       input++;
       stack.push_back(curr);
+      starts.push_back(items.size());
       curr = allocator.alloc<Element>()->setMetadata(line, input - lineStart - 1);
     } else if (input[0] == ')') {
+      if (stack.empty()) throw ParseException("unexpected ')'", line, input - lineStart);
       input++;
-      auto last = curr;
+      finishList(curr, starts.back());
+      items.push_back(curr);
       curr = stack.back();
-      assert(stack.size());
       stack.pop_back();
-      curr->list().push_back(last);
+      starts.pop_back();
     } else {
-      curr->list().push_back(parseString());
+      items.push_back(parseString());
     }
   }
   if (stack.size() != 0) throw ParseException("stack is not empty", curr->line, curr->col);
+  finishList(curr, 0);
   return curr;
 }
 
 void SExpressionParser::skipWhitespace() {
   while (1) {
-    while (isspace(input[0])) {
+    while (isSpace(input[0])) {
       if (input[0] == '\n') {
         line++;
         lineStart = input + 1;
@@ -176,32 +222,23 @@ Element* SExpressionParser::parseString() {
     input++;
     dollared = true;
   }
-  char *start = input;
+  const char *start = input;
   if (input[0] == '"') {
-    // parse escaping \", but leave code escaped - we'll handle escaping in memory segments specifically
+    // skip escaping \", but leave code escaped - we'll handle escaping in memory segments specifically
     input++;
-    std::string str;
-    while (1) {
-      if (input[0] == '"') break;
-      if (input[0] == '\\') {
-        str += input[0];
-        str += input[1];
-        input += 2;
-        continue;
+    while (input[0] != '"') {
+      if (input[0] == 0) throw ParseException("unterminated string", line, start - lineStart);
+      if (input[0] == '\\' && input[1] != 0) {
+        input++;
       }
-      str += input[0];
       input++;
     }
     input++;
-    return allocator.alloc<Element>()->setString(IString(str.c_str(), false), dollared, true)->setMetadata(line, start - lineStart);
+    return allocator.alloc<Element>()->setString(start + 1, input - start - 2, dollared, true)->setMetadata(line, start - lineStart);
   }
-  while (input[0] && !isspace(input[0]) && input[0] != ')' && input[0] != '(' && input[0] != ';') input++;
+  while (!endsString(input[0])) input++;
   if (start == input) throw ParseException("expected string", line, input - lineStart);
-  char temp = input[0];
-  input[0] = 0;
-  auto ret = allocator.alloc<Element>()->setString(IString(start, false), dollared, false)->setMetadata(line, start - lineStart);
-  input[0] = temp;
-  return ret;
+  return allocator.alloc<Element>()->setString(start, input - start, dollared, false)->setMetadata(line, start - lineStart);
 }
 
 SExpressionWasmBuilder::SExpressionWasmBuilder(Module& wasm, Element& module, Name* moduleName) : wasm(wasm), allocator(wasm.allocator), globalCounter(0) {
@@ -241,8 +278,17 @@ SExpressionWasmBuilder::SExpressionWasmBuilder(Module& wasm, Element& module, Na
   for (unsigned j = i; j < module.size(); j++) {
     parseModuleElement(*module[j]);
   }
+  parseFunctionBodies();
+}
+
+SExpressionWasmBuilder::SExpressionWasmBuilder(Module& wasm, Element& function, Function*& output) : wasm(wasm), allocator(wasm.allocator), functionCounter(0), globalCounter(0), functionOutput(&output) {
+  assert(function[0]->str() == FUNC);
+  output = nullptr;
+  parseFunction(function);
 }
 
+SExpressionWasmBuilder::SExpressionWasmBuilder(SExpressionWasmBuilder& parent) : wasm(parent.wasm), allocator(parent.allocator), functionNames(parent.functionNames), functionTypeNames(parent.functionTypeNames), globalNames(parent.globalNames), functionCounter(0), globalCounter(0), functionTypes(parent.functionTypes) {}
+
 bool SExpressionWasmBuilder::isImport(Element& curr) {
   for (Index i = 0; i < curr.size(); i++) {
     auto& x = *curr[i];
@@ -285,18 +331,28 @@ Name SExpressionWasmBuilder::getFunctionName(Element& s) {
     return s.str();
   } else {
     // index
-    size_t offset = atoi(s.str().c_str());
+    size_t offset = atoi(s.text().c_str());
     if (offset >= functionNames.size()) throw ParseException("unknown function in getFunctionName");
     return functionNames[offset];
   }
 }
 
+WasmType SExpressionWasmBuilder::getFunctionResult(Name name) {
+  auto iter = functionTypes.find(name);
+  if (iter != functionTypes.end()) return iter->second;
+  if (functionOutput) {
+    // when parsing just a function, the others are already in the module
+    if (auto* func = wasm.getFunctionOrNull(name)) return func->result;
+  }
+  return none;
+}
+
 Name SExpressionWasmBuilder::getFunctionTypeName(Element& s) {
   if (s.dollared()) {
     return s.str();
   } else {
     // index
-    size_t offset = atoi(s.str().c_str());
+    size_t offset = atoi(s.text().c_str());
     if (offset >= functionTypeNames.size()) throw ParseException("unknown function type in getFunctionTypeName");
     return functionTypeNames[offset];
   }
@@ -307,7 +363,7 @@ Name SExpressionWasmBuilder::getGlobalName(Element& s) {
     return s.str();
   } else {
     // index
-    size_t offset = atoi(s.str().c_str());
+    size_t offset = atoi(s.text().c_str());
     if (offset >= globalNames.size()) throw ParseException("unknown global in getGlobalName");
     return globalNames[offset];
   }
@@ -429,6 +485,20 @@ void SExpressionWasmBuilder::parseFunction(Element& s, bool preParseImport) {
     if (wasm.getExportOrNull(ex->name)) throw ParseException("duplicate export", s.line, s.col);
     wasm.addExport(ex.release());
   }
+  if (preParseImport || functionOutput) {
+    auto* func = parseFunctionBody(s, i, name, preParseImport);
+    if (functionOutput) {
+      for (auto* label : inventedLabels) {
+        *label = Name();
+      }
+      *functionOutput = func;
+    }
+    return;
+  }
+  pendingFunctions.push_back(PendingFunction{ &s, i, name });
+}
+
+Function* SExpressionWasmBuilder::parseFunctionBody(Element& s, size_t i, Name name, bool preParseImport) {
   Expression* body = nullptr;
   localIndex = 0;
   otherIndex = 0;
@@ -541,7 +611,7 @@ void SExpressionWasmBuilder::parseFunction(Element& s, bool preParseImport) {
     assert(!currFunction);
     currLocalTypes.clear();
     nameMapper.clear();
-    return;
+    return nullptr;
   }
   assert(!preParseImport);
   if (brokeToAutoBlock) {
@@ -558,9 +628,88 @@ void SExpressionWasmBuilder::parseFunction(Element& s, bool preParseImport) {
   if (currFunction->result != result) throw ParseException("bad func declaration", s.line, s.col);
   currFunction->body = body;
   currFunction->type = type;
-  wasm.addFunction(currFunction.release());
   currLocalTypes.clear();
   nameMapper.clear();
+  return currFunction.release();
+}
+
+void SExpressionWasmBuilder::parseFunctionBodies() {
+  size_t total = pendingFunctions.size();
+  std::vector<std::unique_ptr<Function>> functions(total);
+  if (total > 1 && ThreadPool::get()->size() > 1) {
+    parseFunctionBodiesInParallel(functions);
+  } else {
+    for (size_t i = 0; i < total; i++) {
+      auto& pending = pendingFunctions[i];
+      functions[i].reset(parseFunctionBody(*pending.s, pending.i, pending.name, false));
+    }
+  }
+  for (auto& func : functions) {
+    wasm.addFunction(func.release());
+  }
+  pendingFunctions.clear();
+}
+
+void SExpressionWasmBuilder::parseFunctionBodiesInParallel(std::vector<std::unique_ptr<Function>>& functions) {
+  size_t total = pendingFunctions.size();
+  size_t num = ThreadPool::get()->size();
+  // start with the largest bodies, so that the workers finish at about the
+  // same time. the lines a function spans are a cheap estimate of its size
+  std::vector<size_t> costs;
+  for (size_t i = 0; i < total; i++) {
+    auto line = pendingFunctions[i].s->line;
+    auto nextLine = i + 1 < total ? pendingFunctions[i + 1].s->line : line + 1;
+    costs.push_back(nextLine > line ? nextLine - line : 1);
+  }
+  WorkStealingQueue queue(num);
+  queue.addByCost(costs);
+  std::vector<std::unique_ptr<SExpressionWasmBuilder>> builders;
+  for (size_t i = 0; i < num; i++) {
+    builders.emplace_back(new SExpressionWasmBuilder(*this));
+  }
+  // whether a function renamed labels that clash with an enclosing one,
+  // which uses a counter that runs through the whole module
+  std::vector<uint8_t> renamedLabels(total);
+  // on an error, report the first one in the module, like a serial parse would
+  std::mutex errorMutex;
+  Index errorIndex = -1;
+  ParseException error;
+  std::vector<std::function<ThreadWorkState ()>> doWorkers;
+  for (size_t i = 0; i < num; i++) {
+    doWorkers.push_back([&, i]() {
+      size_t index;
+      if (!queue.pop(i, index)) {
+        return ThreadWorkState::Finished;
+      }
+      auto& pending = pendingFunctions[index];
+      auto& builder = *builders[i];
+      try {
+        builder.nameMapper.otherIndex = 0;
+        functions[index].reset(builder.parseFunctionBody(*pending.s, pending.i, pending.name, false));
+        renamedLabels[index] = builder.nameMapper.otherIndex != 0;
+      } catch (ParseException& p) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (index < errorIndex) {
+          errorIndex = index;
+          error = p;
+        }
+        // the parsing state was left mid-function, start over with a fresh one
+        builders[i].reset(new SExpressionWasmBuilder(*this));
+      }
+      return ThreadWorkState::More;
+    });
+  }
+  ThreadPool::get()->work(doWorkers);
+  if (errorIndex != Index(-1)) throw error;
+  // the functions that renamed labels are parsed again, in order, so that
+  // they continue the counter from the functions before them, and get the
+  // same names as in a serial parse
+  for (size_t i = 0; i < total; i++) {
+    if (renamedLabels[i]) {
+      auto& pending = pendingFunctions[i];
+      functions[i].reset(parseFunctionBody(*pending.s, pending.i, pending.name, false));
+    }
+  }
 }
 
 WasmType SExpressionWasmBuilder::stringToWasmType(const char* str, bool allowError, bool prefix) {
@@ -908,7 +1057,7 @@ Index SExpressionWasmBuilder::getLocalIndex(Element& s) {
     return currFunction->getLocalIndex(ret);
   }
   // this is a numeric index
-  Index ret = atoi(s.c_str());
+  Index ret = atoi(s.text().c_str());
   if (ret >= currFunction->getNumLocals()) throw ParseException("bad local index", s.line, s.col);
   return ret;
 }
@@ -975,13 +1124,16 @@ Expression* SExpressionWasmBuilder::makeBlock(Element& s) {
       // could be a name or a type
       if (s[i]->dollared() || stringToWasmType(s[i]->str(), true /* allowError */) == none) {
         sName = s[i++]->str();
-      } else {
-        sName = "block";
       }
-    } else {
+    }
+    bool invented = !sName.is();
+    if (invented) {
       sName = "block";
     }
     curr->name = nameMapper.pushLabelName(sName);
+    if (functionOutput && invented) {
+      inventedLabels.push_back(&curr->name);
+    }
     if (i >= s.size()) break; // empty block
     if (s[i]->isStr()) {
       // block signature
@@ -1039,7 +1191,7 @@ Expression* SExpressionWasmBuilder::makeThenOrElse(Element& s) {
 }
 
 Expression* SExpressionWasmBuilder::makeConst(Element& s, WasmType type) {
-  auto ret = parseConst(s[1]->str(), type, allocator);
+  auto ret = parseConst(s[1]->text().c_str(), type, allocator);
   if (!ret) throw ParseException("bad const");
   return ret;
 }
@@ -1067,7 +1219,8 @@ Expression* SExpressionWasmBuilder::makeLoad(Element& s, WasmType type) {
   ret->offset = 0;
   ret->align = ret->bytes;
   while (!s[i]->isList()) {
-    const char *str = s[i]->c_str();
+    auto text = s[i]->text();
+    const char *str = text.c_str();
     const char *eq = strchr(str, '=');
     assert(eq);
     eq++;
@@ -1105,7 +1258,8 @@ Expression* SExpressionWasmBuilder::makeStore(Element& s, WasmType type) {
   ret->offset = 0;
   ret->align = ret->bytes;
   while (!s[i]->isList()) {
-    const char *str = s[i]->c_str();
+    auto text = s[i]->text();
+    const char *str = text.c_str();
     const char *eq = strchr(str, '=');
     assert(eq);
     eq++;
@@ -1177,10 +1331,15 @@ Expression* SExpressionWasmBuilder::makeLoop(Element& s) {
   Name sName;
   if (s.size() > i && s[i]->dollared()) {
     sName = s[i++]->str();
-  } else {
+  }
+  bool invented = !sName.is();
+  if (invented) {
     sName = "loop-in";
   }
   ret->name = nameMapper.pushLabelName(sName);
+  if (functionOutput && invented) {
+    inventedLabels.push_back(&ret->name);
+  }
   ret->type = none;
   if (i < s.size() && s[i]->isStr()) {
     // block signature
@@ -1205,7 +1364,7 @@ Expression* SExpressionWasmBuilder::makeCall(Element& s) {
   }
   auto ret = allocator.alloc<Call>();
   ret->target = target;
-  ret->type = functionTypes[ret->target];
+  ret->type = getFunctionResult(ret->target);
   parseCallOperands(s, 2, s.size(), ret);
   return ret;
 }
@@ -1237,7 +1396,7 @@ Name SExpressionWasmBuilder::getLabel(Element& s) {
     return nameMapper.sourceToUnique(s.str());
   } else {
     // offset, break to nth outside label
-    uint64_t offset = std::stoll(s.c_str(), nullptr, 0);
+    uint64_t offset = std::stoll(s.text(), nullptr, 0);
     if (offset > nameMapper.labelStack.size()) throw ParseException("invalid label", s.line, s.col);
     if (offset == nameMapper.labelStack.size()) {
       // a break to the function's scope. this means we need an automatic block, with a name
@@ -268,6 +268,9 @@ void test_core() {
   // A bunch of our code needs drop(), auto-add it
   BinaryenModuleAutoDrop(module);
 
+  // Reclaim the memory of anything that autodrop replaced
+  BinaryenModuleCompact(module);
+
   // Verify it validates
   assert(BinaryenModuleValidate(module));
 
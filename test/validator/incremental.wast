@@ -0,0 +1,17 @@
+(module
+ (type $v (func))
+ (import "env" "used" (func $used))
+ (import "env" "unused" (func $unused))
+ (export "a" (func $a))
+ (export "b" (func $b))
+ (export "c" (func $c))
+ (func $a
+  (call $used)
+ )
+ (func $b
+  (call $a)
+ )
+ (func $c (result i32)
+  (i32.const 1)
+ )
+)
@@ -0,0 +1,162 @@
+(module
+ (func $f0 (result i32)
+  (f32.const 0.125)
+  (f64.const 0.05)
+  (i32.const 0)
+ )
+ (func $f1 (result i32)
+  (f32.const 1.125)
+  (f64.const 7919.15)
+  (i32.const 1)
+ )
+ (func $f2 (result i32)
+  (f32.const 2.125)
+  (f64.const 15838.25)
+  (i32.const 2)
+ )
+ (func $f3 (result i32)
+  (f32.const 3.125)
+  (f64.const 23757.35)
+  (i32.const 3)
+ )
+ (func $f4 (result i32)
+  (f32.const 4.125)
+  (f64.const 31676.45)
+  (i32.const 4)
+ )
+ (func $f5 (result i32)
+  (f32.const 5.125)
+  (f64.const 39595.55)
+  (i32.const 5)
+ )
+ (func $f6 (result i32)
+  (f32.const 6.125)
+  (f64.const 47514.65)
+  (i32.const 6)
+ )
+ (func $f7 (result i32)
+  (f32.const 7.125)
+  (f64.const 55433.75)
+  (i32.const 7)
+ )
+ (func $f8 (result i32)
+  (f32.const 8.125)
+  (f64.const 63352.85)
+  (i32.const 8)
+ )
+ (func $f9 (result i32)
+  (f32.const 9.125)
+  (f64.const 71271.95)
+  (i32.const 9)
+ )
+ (func $f10 (result i32)
+  (f32.const 10.125)
+  (f64.const 79190.105)
+  (i32.const 10)
+ )
+ (func $f11 (result i32)
+  (f32.const 11.125)
+  (f64.const 87109.115)
+  (i32.const 11)
+ )
+ (func $f12 (result i32)
+  (f32.const 12.125)
+  (f64.const 95028.125)
+  (i32.const 12)
+ )
+ (func $f13 (result i32)
+  (f32.const 13.125)
+  (f64.const 102947.135)
+  (i32.const 13)
+ )
+ (func $f14 (result i32)
+  (f32.const 14.125)
+  (f64.const 110866.145)
+  (i32.const 14)
+ )
+ (func $f15 (result i32)
+  (f32.const 15.125)
+  (f64.const 118785.155)
+  (i32.const 15)
+ )
+ (func $f16 (result i32)
+  (f32.const 16.125)
+  (f64.const 126704.165)
+  (i32.const 16)
+ )
+ (func $f17 (result i32)
+  (f32.const 17.125)
+  (f64.const 134623.175)
+  (i32.const 17)
+ )
+ (func $f18 (result i32)
+  (f32.const 18.125)
+  (f64.const 142542.185)
+  (i32.const 18)
+ )
+ (func $f19 (result i32)
+  (f32.const 19.125)
+  (f64.const 150461.195)
+  (i32.const 19)
+ )
+ (func $f20 (result i32)
+  (f32.const 20.125)
+  (f64.const 158380.205)
+  (i32.const 20)
+ )
+ (func $f21 (result i32)
+  (f32.const 21.125)
+  (f64.const 166299.215)
+  (i32.const 21)
+ )
+ (func $f22 (result i32)
+  (f32.const 22.125)
+  (f64.const 174218.225)
+  (i32.const 22)
+ )
+ (func $f23 (result i32)
+  (f32.const 23.125)
+  (f64.const 182137.235)
+  (i32.const 23)
+ )
+ (func $f24 (result i32)
+  (f32.const 24.125)
+  (f64.const 190056.245)
+  (i32.const 24)
+ )
+ (func $f25 (result i32)
+  (f32.const 25.125)
+  (f64.const 197975.255)
+  (i32.const 25)
+ )
+ (func $f26 (result i32)
+  (f32.const 26.125)
+  (f64.const 205894.265)
+  (i32.const 26)
+ )
+ (func $f27 (result i32)
+  (f32.const 27.125)
+  (f64.const 213813.275)
+  (i32.const 27)
+ )
+ (func $f28 (result i32)
+  (f32.const 28.125)
+  (f64.const 221732.285)
+  (i32.const 28)
+ )
+ (func $f29 (result i32)
+  (f32.const 29.125)
+  (f64.const 229651.295)
+  (i32.const 29)
+ )
+ (func $f30 (result i32)
+  (f32.const 30.125)
+  (f64.const 237570.305)
+  (i32.const 30)
+ )
+ (func $f31 (result i32)
+  (f32.const 31.125)
+  (f64.const 245489.315)
+  (i32.const 31)
+ )
+)